@@ -4,6 +4,21 @@
 #pragma once
 
 #include "../include/realsense_node_factory.h"
+#include "../include/compressed_image_publisher.h"
+#include "../include/depth_deprojector.h"
+#include "../include/frame_image.h"
+#include "../include/height_map_builder.h"
+#include "../include/image_kernels.h"
+#include "../include/image_pyramid_publisher.h"
+#include "../include/laser_scan_publisher.h"
+#include "../include/message_pool.h"
+#include "../include/point_cloud_builder.h"
+#include "../include/point_cloud_kernels.h"
+#include "../include/publish_throttle.h"
+#include "../include/publish_worker.h"
+#include "../include/subscriber_tracker.h"
+#include "../include/voxel_grid.h"
+#include "../include/worker_pool.h"
 
 #include <ddynamic_reconfigure/ddynamic_reconfigure.h>
 #include <diagnostic_updater/diagnostic_updater.h>
@@ -18,10 +33,12 @@
 
 #include <std_srvs/SetBool.h>
 #include <any_realsense2_msgs/FrameMetadataMsg.h>
+#include <any_realsense2_msgs/HeightMap.h>
 #include <any_realsense2_msgs/TimeOffsetsMsg.h>
 #include <any_realsense2_msgs/TimestampingInfoMsg.h>
 
 #include <condition_variable>
+#include <functional>
 #include <queue>
 #include <mutex>
 #include <atomic>
@@ -128,6 +145,96 @@ namespace realsense2_camera
     };
     typedef std::pair<image_transport::Publisher, std::shared_ptr<FrequencyDiagnostics>> ImagePublisherWithFrequencyDiagnostics;
 
+    //* Recycled messages of one image topic and its camera info.
+    struct ImageMessagePools
+    {
+        explicit ImageMessagePools(std::size_t capacity) :
+          image(capacity), camera_info(capacity)
+        {}
+
+        void diagnostics(diagnostic_updater::DiagnosticStatusWrapper& status)
+        {
+            status.summary(0, "OK");
+            status.add("Image pool hits", image.hits());
+            status.add("Image pool misses", image.misses());
+            status.add("CameraInfo pool hits", camera_info.hits());
+            status.add("CameraInfo pool misses", camera_info.misses());
+        }
+
+        MessagePool<sensor_msgs::Image> image;
+        MessagePool<sensor_msgs::CameraInfo> camera_info;
+    };
+
+    //* Times of the depth alignment to one stream since the previous report, which is made with the
+    //* diagnostics of its aligned depth topic from the same thread as add().
+    struct AlignmentTimes
+    {
+        void add(double time)
+        {
+            ++aligned;
+            ++period_count;
+            last_time = time;
+            total_time += time;
+            max_time = std::max(max_time, time);
+        }
+
+        void diagnostics(diagnostic_updater::DiagnosticStatusWrapper& status)
+        {
+            status.summary(0, "OK");
+            status.add("Frames aligned", aligned);
+            status.add("Last align time (ms)", last_time);
+            status.add("Mean align time (ms)", period_count ? total_time / period_count : 0.0);
+            status.add("Max align time (ms)", max_time);
+            period_count = 0;
+            total_time = 0;
+            max_time = 0;
+        }
+
+        uint64_t aligned = 0;
+        uint64_t period_count = 0;
+        double last_time = 0;
+        double total_time = 0;
+        double max_time = 0;
+    };
+
+    //* Part of an image topic which is published: a region of interest, binned by an integer factor.
+    //* A width or height of 0 extends the region to the image border.
+    struct ImageRegion
+    {
+        int x_offset = 0;
+        int y_offset = 0;
+        int width = 0;
+        int height = 0;
+        int binning = 1;
+
+        bool isActive() const
+        {
+            return x_offset > 0 || y_offset > 0 || width > 0 || height > 0 || binning > 1;
+        }
+
+        //* The region within an image of the given size. Its width and height are rounded down to
+        //* multiples of the binning, so that every output pixel covers a full block.
+        ImageRegion clamped(int image_width, int image_height) const
+        {
+            ImageRegion region;
+            region.binning = std::max(binning, 1);
+            region.x_offset = std::min(std::max(x_offset, 0), image_width);
+            region.y_offset = std::min(std::max(y_offset, 0), image_height);
+            region.width = image_width - region.x_offset;
+            region.height = image_height - region.y_offset;
+            if (width > 0)
+                region.width = std::min(width, region.width);
+            if (height > 0)
+                region.height = std::min(height, region.height);
+            region.width -= region.width % region.binning;
+            region.height -= region.height % region.binning;
+            return region;
+        }
+
+        int outputWidth() const { return width / binning; }
+        int outputHeight() const { return height / binning; }
+    };
+
     class TemperatureDiagnostics
     {
         public:
@@ -243,6 +350,24 @@ namespace realsense2_camera
             varying_offsets,
         };
 
+        //* Processing stages of frame_callback. Every output depends on a set of stages; for each frame
+        //* only the stages required by outputs that currently have subscribers are run.
+        enum processing_stage : uint32_t {
+            STAGE_METADATA      = 1 << 0,
+            STAGE_CLIP_DEPTH    = 1 << 1,
+            STAGE_DEPTH_FILTERS = 1 << 2,
+            STAGE_POINTCLOUD    = 1 << 3,
+            STAGE_ALIGN_DEPTH   = 1 << 4,
+            STAGE_HEIGHT_MAP    = 1 << 5,
+        };
+
+        struct ProcessingOutput
+        {
+            std::string name;
+            uint64_t topics;
+            uint32_t stages;
+        };
+
         bool _is_running;
         std::string _base_frame_id;
         std::string _odom_frame_id;
@@ -284,19 +409,44 @@ namespace realsense2_camera
         void setupDevice();
         void setupErrorCallback();
         void setupPublishers();
+        std::shared_ptr<ImageMessagePools> createImageMessagePools(const stream_index_pair& stream, int unit_step_size,
+                                                                   FrequencyDiagnostics& frequency_diagnostics);
+        void advertiseCompressedImage(const std::shared_ptr<CompressedImagePublisher>& publisher, const std::string& topic,
+                                      uint64_t& image_subscribers, std::vector<std::shared_ptr<DerivedImagePublisher>>& derived_publishers,
+                                      FrequencyDiagnostics& frequency_diagnostics);
+        void advertiseConvertedImage(image_transport::ImageTransport& image_transport,
+                                     const std::shared_ptr<ConvertedImagePublisher>& publisher,
+                                     const std::string& topic, uint64_t& image_subscribers,
+                                     std::vector<std::shared_ptr<DerivedImagePublisher>>& derived_publishers);
+        void advertisePyramid(image_transport::ImageTransport& image_transport, const std::string& stream_name,
+                              const std::string& image_name, int level_count, uint64_t& image_subscribers,
+                              std::vector<std::shared_ptr<DerivedImagePublisher>>& derived_publishers);
         void enable_devices();
         void setupFilters();
         void setupStreams();
         void setBaseTime(double frame_time, bool warn_no_metadata);
-        cv::Mat& fix_depth_scale(const cv::Mat& from_image, cv::Mat& to_image);
-        void clip_depth(rs2::depth_frame depth_frame, float clipping_dist);
+        bool isDepthClipEnabled() const;
+        void depthClipRange(uint16_t& min_value, uint16_t& max_value) const;
+        void clip_depth(rs2::depth_frame depth_frame);
+        void process_depth(const uint16_t* from, int from_stride, uint16_t* to, int width, int height, bool clip, bool rescale);
+        //* Runs tile_function(begin, end) on _image_pool for tiles of rows [begin, end) covering [0, height).
+        void forEachRowTile(int height, const std::function<void(int begin, int end)>& tile_function);
+        void copyImageRegion(const uint8_t* from, int from_width, int bpp, const ImageRegion& region,
+                             bool is_depth, bool clip, bool rescale, uint8_t* to);
         void updateStreamCalibData(const rs2::video_stream_profile& video_profile);
         void SetBaseStream();
         void publishStaticTransforms();
+        void setDepthToBaseTransform(const rs2::stream_profile& base_profile);
         void publishDynamicTransforms();
         void publishIntrinsics();
         void runFirstFrameInitialization(rs2_stream stream_type);
-        void publishPointCloud(rs2::points f, const ros::Time& t, const rs2::frameset& frameset);
+        void publishPointCloud(const rs2::depth_frame& depth_frame, const ros::Time& t, const rs2::frameset& frameset);
+        void publishPointsWithNormals(const rs2::depth_frame& depth_frame, const ros::Time& t);
+        void publishHeightMap(const rs2::depth_frame& depth_frame, const ros::Time& t);
+        //* Fills msg, whose fields are set, with the points of a width x height depth image deprojected
+        //* by _deprojector, found and written by build_chunk (see PointCloudBuilder).
+        void buildPointCloud(sensor_msgs::PointCloud2& msg, const uint16_t* depth, float depth_unit, int width, int height,
+                             bool ordered, const PointCloudBuilder::ChunkFunction& build_chunk);
         Extrinsics rsExtrinsicsToMsg(const rs2_extrinsics& extrinsics, const std::string& frame_id) const;
 
         IMUInfo getImuInfo(const stream_index_pair& stream_index);
@@ -305,6 +455,11 @@ namespace realsense2_camera
                           std::map<stream_index_pair, cv::Mat>& images,
                           const std::map<stream_index_pair, ros::Publisher>& info_publishers,
                           const std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics>& image_publishers,
+                          const std::map<stream_index_pair, ros::Publisher>& zero_copy_image_publishers,
+                          const std::map<stream_index_pair, uint64_t>& image_subscribers,
+                          const std::map<stream_index_pair, ImageRegion>& image_regions,
+                          const std::map<stream_index_pair, std::vector<std::shared_ptr<DerivedImagePublisher>>>& derived_publishers,
+                          const std::map<stream_index_pair, std::shared_ptr<ImageMessagePools>>& message_pools,
                           std::map<stream_index_pair, int>& seq,
                           std::map<stream_index_pair, sensor_msgs::CameraInfo>& camera_info,
                           const std::map<stream_index_pair, std::string>& optical_frame_id,
@@ -313,6 +468,15 @@ namespace realsense2_camera
         bool getEnabledProfile(const stream_index_pair& stream_index, rs2::stream_profile& profile);
 
         void publishAlignedDepthToOthers(rs2::frameset frames, const ros::Time& t);
+        void setupProcessingGraph();
+        PublishThrottle readPublishThrottle(const std::string& topic_name);
+        ImageRegion readImageRegion(const std::string& topic_name);
+        //* Aligns the region of interest of packed YUV images (pixel_pairs) to pairs of pixels, and
+        //* replaces regions without any pixel in the image by the full image.
+        ImageRegion checkImageRegion(const std::string& topic_name, const ImageRegion& region, int width, int height,
+                                     bool pixel_pairs) const;
+        std::function<void(rs2::frame)> queued(const std::string& name, std::function<void(rs2::frame)> callback, int queue_size);
+        uint32_t requiredProcessingStages() const;
         sensor_msgs::Imu CreateUnitedMessage(const CimuData accel_data, const CimuData gyro_data);
 
         void FillImuData_Copy(const CimuData imu_data, std::deque<sensor_msgs::Imu>& imu_msgs);
@@ -343,13 +507,23 @@ namespace realsense2_camera
         rs2::device _dev;
         std::map<stream_index_pair, rs2::sensor> _sensors;
         std::map<std::string, std::function<void(rs2::frame)>> _sensors_callback;
+        int _publish_queue_size;
+        int _imu_publish_queue_size;
+        PublishWorker::drop_policy _publish_queue_policy;
+        std::vector<std::shared_ptr<PublishWorker>> _publish_workers;
         std::vector<std::shared_ptr<ddynamic_reconfigure::DDynamicReconfigure>> _ddynrec;
 
         std::string _json_file_path;
         std::string _serial_no;
         float _depth_scale_meters;
         float _clipping_distance;
+        float _clipping_distance_min;
+        bool _clip_depth_in_place;
+        std::vector<ProcessingOutput> _processing_outputs;
+        uint32_t _always_required_stages;
         bool _allow_no_texture_points;
+        bool _ordered_pc;
+        bool _zero_copy_images;
 
         double _linear_accel_cov;
         double _angular_velocity_cov;
@@ -370,8 +544,30 @@ namespace realsense2_camera
         std::shared_ptr<std::thread> _tf_t;
 
         std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics> _image_publishers;
+        std::map<stream_index_pair, PublishThrottle> _image_throttles;
+        std::map<stream_index_pair, ImageRegion> _image_regions;
+        std::map<stream_index_pair, int> _pyramid_levels;
+        int _pyramid_threads;
+        std::map<stream_index_pair, std::vector<std::shared_ptr<DerivedImagePublisher>>> _derived_publishers;
+        int _depth_rvl_bands;
+        int _depth_rvl_threads;
+        int _jpeg_quality;
+        int _jpeg_threads;
+        bool _image_meters;
+        bool _scan;
+        int _scan_row;
+        int _scan_height;
+        double _scan_range_min;
+        double _scan_range_max;
+        std::string _color_conversion_encoding;
+        std::map<stream_index_pair, ros::Publisher> _zero_copy_image_publishers;
+        std::map<stream_index_pair, std::shared_ptr<ImageMessagePools>> _image_message_pools;
         std::map<stream_index_pair, ros::Publisher> _imu_publishers;
         std::shared_ptr<SyncedImuPublisher> _synced_imu_publisher;
+        SubscriberTracker _subscribers;
+        std::map<stream_index_pair, uint64_t> _image_subscribers;
+        std::map<stream_index_pair, uint64_t> _imu_subscribers;
+        uint64_t _synced_imu_subscribers;
         std::map<rs2_stream, int> _image_format;
         std::map<stream_index_pair, ros::Publisher> _info_publisher;
         std::map<stream_index_pair, cv::Mat> _image;
@@ -385,6 +581,21 @@ namespace realsense2_camera
         std::map<stream_index_pair, std::vector<rs2::stream_profile>> _enabled_profiles;
 
         ros::Publisher _pointcloud_publisher;
+        PublishThrottle _pointcloud_throttle;
+        uint64_t _pointcloud_subscribers;
+        DepthDeprojector _deprojector;
+        std::unique_ptr<PointCloudBuilder> _pointcloud_builder;
+        std::unique_ptr<VoxelGrid> _voxel_grid;
+        crop_volume _pointcloud_crop;
+        bool _pointcloud_crop_enabled;
+        bool _pointcloud_crop_in_base_frame;
+        ros::Publisher _normals_publisher;
+        uint64_t _normals_subscribers;
+        bool _pointcloud_normals;
+        int _pointcloud_normals_radius;
+        ros::Publisher _height_map_publisher;
+        uint64_t _height_map_subscribers;
+        std::unique_ptr<HeightMapBuilder> _height_map;
         ros::Time _ros_time_base;
         bool _sync_frames;
         bool _pointcloud;
@@ -394,6 +605,7 @@ namespace realsense2_camera
         
         //* Custom attributes
         ros::Publisher _timestamping_info_publisher;
+        uint64_t _timestamping_info_subscribers;
         timestamping_method _timestamping_method;
         double _fixed_time_offset = 0.0;
         ros::ServiceServer _toggleColorService;
@@ -405,15 +617,23 @@ namespace realsense2_camera
         PipelineSyncer _syncer;
         std::vector<NamedFilter> _filters;
         std::vector<rs2::sensor> _dev_sensors;
-        std::map<rs2_stream, std::shared_ptr<rs2::align>> _align;
+        std::map<stream_index_pair, std::shared_ptr<rs2::align>> _align;
+        std::map<stream_index_pair, std::shared_ptr<AlignmentTimes>> _depth_aligned_times;
+        std::unique_ptr<WorkerPool> _align_pool;
+        std::unique_ptr<WorkerPool> _image_pool;
 
         std::map<stream_index_pair, cv::Mat> _depth_aligned_image;
-        std::map<stream_index_pair, cv::Mat> _depth_scaled_image;
         std::map<rs2_stream, std::string> _depth_aligned_encoding;
         std::map<stream_index_pair, sensor_msgs::CameraInfo> _depth_aligned_camera_info;
         std::map<stream_index_pair, int> _depth_aligned_seq;
         std::map<stream_index_pair, ros::Publisher> _depth_aligned_info_publisher;
         std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics> _depth_aligned_image_publishers;
+        std::map<stream_index_pair, PublishThrottle> _depth_aligned_throttles;
+        std::map<stream_index_pair, ImageRegion> _depth_aligned_image_regions;
+        std::map<stream_index_pair, std::vector<std::shared_ptr<DerivedImagePublisher>>> _depth_aligned_derived_publishers;
+        std::map<stream_index_pair, ros::Publisher> _depth_aligned_zero_copy_image_publishers;
+        std::map<stream_index_pair, uint64_t> _depth_aligned_image_subscribers;
+        std::map<stream_index_pair, std::shared_ptr<ImageMessagePools>> _depth_aligned_image_message_pools;
         std::map<stream_index_pair, ros::Publisher> _depth_to_other_extrinsics_publishers;
         std::map<stream_index_pair, rs2_extrinsics> _depth_to_other_extrinsics;
         std::map<std::string, rs2::region_of_interest> _auto_exposure_roi;
@@ -0,0 +1,119 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+namespace realsense2_camera
+{
+    //* Bounded lock-free queue (D. Vyukov's bounded MPMC algorithm).
+    //* Every slot carries a sequence number telling whether it may be written or read at a given
+    //* position, so producers and consumers never wait on each other. The queue is used with a
+    //* single producer and a single consumer, but the producer may also pop, which is how the
+    //* oldest element is evicted when the queue is full.
+    template <typename T>
+    class BoundedQueue
+    {
+        public:
+            explicit BoundedQueue(std::size_t capacity) :
+                _capacity(capacity), _slots(new Slot[capacity]), _push_pos(0), _pop_pos(0)
+            {
+                // With a single slot, a full and an empty slot would carry the same sequence number.
+                if (capacity < 2)
+                {
+                    throw std::invalid_argument("BoundedQueue: capacity must be at least 2");
+                }
+                for (std::size_t i = 0; i < capacity; ++i)
+                {
+                    _slots[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            BoundedQueue(const BoundedQueue&) = delete;
+            BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+            //* Returns false, leaving the value untouched, if the queue is full.
+            bool tryPush(T& value)
+            {
+                std::size_t pos = _push_pos.load(std::memory_order_relaxed);
+                Slot* slot;
+                for (;;)
+                {
+                    slot = &_slots[pos % _capacity];
+                    std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                    std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+                    if (diff == 0)
+                    {
+                        if (_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                            break;
+                    }
+                    else if (diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = _push_pos.load(std::memory_order_relaxed);
+                    }
+                }
+                slot->value = std::move(value);
+                slot->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            //* Returns false if the queue is empty.
+            bool tryPop(T& value)
+            {
+                std::size_t pos = _pop_pos.load(std::memory_order_relaxed);
+                Slot* slot;
+                for (;;)
+                {
+                    slot = &_slots[pos % _capacity];
+                    std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                    std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+                    if (diff == 0)
+                    {
+                        if (_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                            break;
+                    }
+                    else if (diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = _pop_pos.load(std::memory_order_relaxed);
+                    }
+                }
+                value = std::move(slot->value);
+                // Release the element (e.g. a frame handle) right away rather than when the slot is reused.
+                slot->value = T();
+                slot->sequence.store(pos + _capacity, std::memory_order_release);
+                return true;
+            }
+
+            bool empty() const
+            {
+                return _pop_pos.load(std::memory_order_seq_cst) >= _push_pos.load(std::memory_order_seq_cst);
+            }
+
+            std::size_t capacity() const { return _capacity; }
+
+        private:
+            struct Slot
+            {
+                std::atomic<std::size_t> sequence;
+                T value;
+            };
+
+            const std::size_t _capacity;
+            std::unique_ptr<Slot[]> _slots;
+            // Keep the producer and consumer positions on separate cache lines.
+            alignas(64) std::atomic<std::size_t> _push_pos;
+            alignas(64) std::atomic<std::size_t> _pop_pos;
+    };
+}
@@ -0,0 +1,139 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/derived_image_publisher.h"
+#include "../include/jpeg_encoder.h"
+#include "../include/rvl_codec.h"
+
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <ros/ros.h>
+#include <sensor_msgs/CompressedImage.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace realsense2_camera
+{
+    //* Publishes a compressed variant of an image topic, encoded in the node from the pixels of the
+    //* published image. Encoding times are reported as diagnostics of the image topic.
+    class CompressedImagePublisher : public DerivedImagePublisher
+    {
+        public:
+            explicit CompressedImagePublisher(const std::string& name, std::size_t pool_capacity) :
+                _name(name), _messages(pool_capacity),
+                _encoded(0), _failed(0), _last_time(0), _total_time(0), _max_time(0), _period_count(0)
+            {}
+
+            void publish(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                         const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) override
+            {
+                sensor_msgs::CompressedImagePtr msg = _messages.acquire();
+                const auto start = std::chrono::steady_clock::now();
+                const bool encoded = encode(data, width, height, step, encoding, *msg);
+                const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (!encoded)
+                {
+                    ++_failed;
+                    return;
+                }
+                ++_encoded;
+                ++_period_count;
+                _last_time = time;
+                _total_time += time;
+                _max_time = std::max(_max_time, time);
+
+                msg->header = header;
+                publisher.publish(msg);
+            }
+
+            //* Reports the encoding times since the previous report, which comes from the same thread as publish().
+            void diagnostics(diagnostic_updater::DiagnosticStatusWrapper& status)
+            {
+                status.summary(_failed ? 1 : 0, _failed ? "Encoding failures" : "OK");
+                status.add("Topic", publisher.getTopic());
+                status.add("Frames encoded", _encoded);
+                status.add("Frames failed", _failed);
+                status.add("Last encode time (ms)", _last_time);
+                status.add("Mean encode time (ms)", _period_count ? _total_time / _period_count : 0.0);
+                status.add("Max encode time (ms)", _max_time);
+                _period_count = 0;
+                _total_time = 0;
+                _max_time = 0;
+            }
+
+            const std::string& name() const { return _name; }
+
+            ros::Publisher publisher;
+
+        protected:
+            virtual bool encode(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                                sensor_msgs::CompressedImage& msg) = 0;
+
+        private:
+            const std::string _name;
+            MessagePool<sensor_msgs::CompressedImage> _messages;
+            uint64_t _encoded;
+            uint64_t _failed;
+            double _last_time;
+            double _total_time;
+            double _max_time;
+            uint64_t _period_count;
+    };
+
+    //* Lossless RVL compressed depth, see rvl_codec.h.
+    class RvlImagePublisher : public CompressedImagePublisher
+    {
+        public:
+            RvlImagePublisher(int band_count, int threads, std::size_t pool_capacity) :
+                CompressedImagePublisher("RVL", pool_capacity), _encoder(band_count, threads)
+            {}
+
+            bool canPublish(const std::string& encoding) const override
+            {
+                return encoding == sensor_msgs::image_encodings::TYPE_16UC1 || encoding == sensor_msgs::image_encodings::MONO16;
+            }
+
+        protected:
+            bool encode(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                        sensor_msgs::CompressedImage& msg) override
+            {
+                if (step != width * static_cast<int>(sizeof(uint16_t)))
+                    return false;
+                msg.format = rvl::FORMAT;
+                _encoder.encode(reinterpret_cast<const uint16_t*>(data), width, height, msg.data);
+                return true;
+            }
+
+        private:
+            rvl::Encoder _encoder;
+    };
+
+    //* JPEG compressed color or grayscale images, in the format of the compressed image_transport
+    //* plugin, so its subscribers decode them. Packed YUV 4:2:2 is announced as RGB8.
+    class JpegImagePublisher : public CompressedImagePublisher
+    {
+        public:
+            JpegImagePublisher(int quality, int threads, std::size_t pool_capacity) :
+                CompressedImagePublisher("JPEG", pool_capacity), _encoder(quality, threads)
+            {}
+
+            bool canPublish(const std::string& encoding) const override
+            {
+                return JpegEncoder::canEncode(encoding);
+            }
+
+        protected:
+            bool encode(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                        sensor_msgs::CompressedImage& msg) override
+            {
+                const std::string& source_encoding = isPackedYuv422(encoding) ? sensor_msgs::image_encodings::RGB8 : encoding;
+                msg.format = source_encoding + "; jpeg compressed " + (encoding == sensor_msgs::image_encodings::MONO8 ? "mono8" : "bgr8");
+                return _encoder.encode(data, width, height, step, encoding, msg.data);
+            }
+
+        private:
+            JpegEncoder _encoder;
+    };
+}
@@ -37,9 +37,47 @@ namespace realsense2_camera
     
 
     const bool ALIGN_DEPTH    = false;
+    const int  ALIGN_DEPTH_THREADS = 3;
     const bool POINTCLOUD     = false;
     const bool ALLOW_NO_TEXTURE_POINTS = false;
+    const bool ORDERED_PC     = false;
+    const int  POINTCLOUD_THREADS = 2;
+    const double POINTCLOUD_VOXEL_SIZE = 0; // Disabled
+    const std::string POINTCLOUD_VOXEL_POLICY = "centroid";
+    const int  POINTCLOUD_VOXEL_THREADS = 2;
+    const std::string POINTCLOUD_CROP_FRAME = "optical";
+    const bool POINTCLOUD_NORMALS = false;
+    const int  POINTCLOUD_NORMALS_RADIUS = 2;
+    const float NORMALS_MAX_DEPTH_CHANGE = 0.02f; // Per pixel of radius, relative to the depth
+    const bool HEIGHT_MAP     = false;
+    const double HEIGHT_MAP_RESOLUTION = 0.04;
+    const int  HEIGHT_MAP_THREADS = 2;
     const bool SYNC_FRAMES    = false;
+    const bool ZERO_COPY_IMAGES = false;
+    const int  IMAGE_MESSAGE_POOL_SIZE = 4;
+    const int  PUBLISH_QUEUE_SIZE = 0;
+    const std::string PUBLISH_QUEUE_POLICY = "drop_oldest";
+    const int  IMU_PUBLISH_QUEUE_SIZE = 256; // About 0.4 s of D435i samples at 400 Hz gyro and 250 Hz accel
+    const int  IMAGE_THREADS = 2;
+    const int  PUBLISH_EVERY_N = 1;
+    const double MAX_PUBLISH_RATE = 0; // Unlimited
+    const int  IMAGE_ROI_OFFSET = 0;
+    const int  IMAGE_ROI_SIZE = 0; // Up to the image border
+    const int  IMAGE_BINNING = 1;
+    const int  PYRAMID_LEVELS = 0;
+    const int  PYRAMID_THREADS = 2;
+    const int  DEPTH_RVL_BANDS = 4;
+    const int  DEPTH_RVL_THREADS = 2;
+    const int  JPEG_QUALITY = 80;
+    const int  JPEG_THREADS = 2;
+    const bool IMAGE_METERS = false;
+    const bool SCAN = false;
+    const int  SCAN_ROW = -1; // Row of the principal point
+    const int  SCAN_HEIGHT = 1;
+    const double SCAN_RANGE_MIN = 0.45;
+    const double SCAN_RANGE_MAX = 10.0;
+    const std::string COLOR_FORMAT = "rgb8";
+    const std::string COLOR_CONVERSION_ENCODING = "rgb8";
 
     const bool PUBLISH_TF        = true;
     const double TF_PUBLISH_RATE = 0; // Static transform
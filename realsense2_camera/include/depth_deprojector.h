@@ -0,0 +1,96 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/point_cloud_kernels.h"
+
+#include <any_librealsense2/rs.hpp>
+#include <any_librealsense2/rsutil.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Deprojects depth images into points. The ray of every pixel, distortion included, is
+    //* computed once per set of intrinsics and kept in a table, so that a point only costs a
+    //* multiplication of its ray by its depth.
+    class DepthDeprojector
+    {
+        public:
+            DepthDeprojector() : _intrinsics() {}
+
+            //* Rebuilds the ray table if the intrinsics are not those it was built for.
+            void setIntrinsics(const rs2_intrinsics& intrinsics)
+            {
+                if (!_ray_x.empty() && sameIntrinsics(intrinsics, _intrinsics))
+                    return;
+                _intrinsics = intrinsics;
+                const int width = intrinsics.width;
+                const int height = intrinsics.height;
+                _ray_x.resize(static_cast<std::size_t>(width) * height);
+                _ray_y.resize(_ray_x.size());
+                #ifdef _OPENMP
+                #pragma omp parallel for schedule(dynamic) //Using OpenMP to try to parallelise the loop
+                #endif
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        const float pixel[2] = {static_cast<float>(x), static_cast<float>(y)};
+                        float ray[3];
+                        rs2_deproject_pixel_to_point(ray, &_intrinsics, pixel, 1.f);
+                        _ray_x[static_cast<std::size_t>(y) * width + x] = ray[0];
+                        _ray_y[static_cast<std::size_t>(y) * width + x] = ray[1];
+                    }
+                }
+            }
+
+            //* Number of pixels of the depth images.
+            std::size_t size() const { return _ray_x.size(); }
+
+            //* Rays of the pixels, row by row: a point is (ray_x * z, ray_y * z, z).
+            const float* rayX() const { return _ray_x.data(); }
+            const float* rayY() const { return _ray_y.data(); }
+
+            //* Writes x, y, z of count pixels, starting at pixel begin, to vertices (see deproject_depth()).
+            void deproject(const uint16_t* depth, std::size_t begin, std::size_t count, float depth_unit, float* vertices) const
+            {
+                deproject_depth(depth + begin, _ray_x.data() + begin, _ray_y.data() + begin, count, depth_unit, vertices);
+            }
+
+            //* Texture coordinates (pixel position divided by the image size, as in librealsense point
+            //* clouds) of count points in a texture. Points without depth get (-1, -1).
+            static void projectToTexture(const float* vertices, std::size_t count, const rs2_extrinsics& depth_to_texture,
+                                         const rs2_intrinsics& texture_intrinsics, float* texcoords)
+            {
+                const float inv_width = 1.f / texture_intrinsics.width;
+                const float inv_height = 1.f / texture_intrinsics.height;
+                for (std::size_t i = 0; i < count; ++i, vertices += 3, texcoords += 2)
+                {
+                    if (vertices[2] <= 0.f)
+                    {
+                        texcoords[0] = texcoords[1] = -1.f;
+                        continue;
+                    }
+                    float point[3];
+                    float pixel[2];
+                    rs2_transform_point_to_point(point, &depth_to_texture, vertices);
+                    rs2_project_point_to_pixel(pixel, &texture_intrinsics, point);
+                    texcoords[0] = pixel[0] * inv_width;
+                    texcoords[1] = pixel[1] * inv_height;
+                }
+            }
+
+        private:
+            static bool sameIntrinsics(const rs2_intrinsics& a, const rs2_intrinsics& b)
+            {
+                return a.width == b.width && a.height == b.height && a.ppx == b.ppx && a.ppy == b.ppy &&
+                       a.fx == b.fx && a.fy == b.fy && a.model == b.model && std::equal(a.coeffs, a.coeffs + 5, b.coeffs);
+            }
+
+            rs2_intrinsics _intrinsics;
+            std::vector<float> _ray_x;
+            std::vector<float> _ray_y;
+    };
+}
@@ -0,0 +1,163 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/image_kernels.h"
+#include "../include/message_pool.h"
+
+#include <image_transport/image_transport.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <std_msgs/Header.h>
+
+#include <string>
+
+namespace realsense2_camera
+{
+    //* sensor_msgs encodings of packed YUV 4:2:2: "yuv422" is UYVY, "yuv422_yuy2" is YUYV.
+    const std::string YUV422_UYVY = "yuv422";
+    const std::string YUV422_YUYV = "yuv422_yuy2";
+
+    inline bool isPackedYuv422(const std::string& encoding)
+    {
+        return encoding == YUV422_UYVY || encoding == YUV422_YUYV;
+    }
+
+    //* Topic produced from the pixels of a published image topic, e.g. a compressed or color
+    //* converted variant. It shares the camera info of the image topic, and its subscribers
+    //* count as subscribers of the image topic, so that the image is produced for it.
+    class DerivedImagePublisher
+    {
+        public:
+            DerivedImagePublisher() : subscribers(0) {}
+            virtual ~DerivedImagePublisher() = default;
+
+            virtual bool canPublish(const std::string& encoding) const = 0;
+
+            //* data holds height rows of step bytes, in the encoding of the image topic; info is its camera info.
+            virtual void publish(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                                 const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) = 0;
+
+            //* Whether it is made by publishDepth() from the depth of the frame, rather than from the
+            //* pixels of the image topic, whose depth is rounded to ROS_DEPTH_SCALE units.
+            virtual bool usesFrameDepth() const { return false; }
+
+            //* depth holds height rows of width pixels in units of depth_unit meters, clipped, cropped
+            //* and binned like the image topic.
+            virtual void publishDepth(const uint16_t* depth, float depth_unit, int width, int height,
+                                      const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) {}
+
+            uint64_t subscribers;
+    };
+
+    //* Image topic converted row by row from the pixels of another image topic, so that consumers
+    //* which need the conversion get it without every frame being converted.
+    class ConvertedImagePublisher : public DerivedImagePublisher
+    {
+        public:
+            ConvertedImagePublisher(const std::string& encoding, int pixel_size, std::size_t pool_capacity) :
+                _encoding(encoding), _pixel_size(pixel_size), _messages(pool_capacity)
+            {}
+
+            void publish(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                         const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) override
+            {
+                sensor_msgs::ImagePtr img = _messages.acquire();
+                img->header = header;
+                img->encoding = _encoding;
+                img->width = width;
+                img->height = height;
+                img->is_bigendian = false;
+                img->step = width * _pixel_size;
+                img->data.resize(img->step * height);
+                uint8_t* out = img->data.data();
+                const std::size_t out_step = img->step;
+
+                #ifdef _OPENMP
+                #pragma omp parallel for schedule(dynamic) //Using OpenMP to try to parallelise the loop
+                #endif
+                for (int y = 0; y < height; y++)
+                {
+                    convertRow(data + y * step, out + y * out_step, width, encoding);
+                }
+                publisher.publish(img);
+            }
+
+            const std::string& encoding() const { return _encoding; }
+
+            image_transport::Publisher publisher;
+
+        protected:
+            virtual void convertRow(const uint8_t* src, uint8_t* dst, int width, const std::string& encoding) const = 0;
+
+        private:
+            const std::string _encoding;
+            const int _pixel_size;
+            MessagePool<sensor_msgs::Image> _messages;
+    };
+
+    //* RGB8, BGR8 or MONO8 conversion of a packed YUV 4:2:2 image topic.
+    class Yuv422ImagePublisher : public ConvertedImagePublisher
+    {
+        public:
+            Yuv422ImagePublisher(const std::string& encoding, std::size_t pool_capacity) :
+                ConvertedImagePublisher(encoding, encoding == sensor_msgs::image_encodings::MONO8 ? 1 : 3, pool_capacity),
+                _mono(encoding == sensor_msgs::image_encodings::MONO8),
+                _bgr(encoding == sensor_msgs::image_encodings::BGR8)
+            {}
+
+            bool canPublish(const std::string& encoding) const override
+            {
+                return isPackedYuv422(encoding);
+            }
+
+        protected:
+            void convertRow(const uint8_t* src, uint8_t* dst, int width, const std::string& encoding) const override
+            {
+                if (_mono)
+                    yuv422_to_mono(src, dst, width, encoding == YUV422_UYVY);
+                else
+                    yuv422_to_rgb(src, dst, width, encoding == YUV422_UYVY, _bgr);
+            }
+
+        private:
+            const bool _mono;
+            const bool _bgr;
+    };
+
+    //* 32FC1 depth in meters, converted from the depth of the frame so that it keeps the precision
+    //* of the camera's depth unit. Invalid (zero) depth becomes NaN.
+    class MetricDepthImagePublisher : public ConvertedImagePublisher
+    {
+        public:
+            explicit MetricDepthImagePublisher(std::size_t pool_capacity) :
+                ConvertedImagePublisher(sensor_msgs::image_encodings::TYPE_32FC1, sizeof(float), pool_capacity),
+                _depth_unit(0)
+            {}
+
+            bool canPublish(const std::string& encoding) const override
+            {
+                return encoding == sensor_msgs::image_encodings::TYPE_16UC1;
+            }
+
+            bool usesFrameDepth() const override { return true; }
+
+            void publishDepth(const uint16_t* depth, float depth_unit, int width, int height,
+                              const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) override
+            {
+                _depth_unit = depth_unit;
+                publish(reinterpret_cast<const uint8_t*>(depth), width, height, width * sizeof(uint16_t),
+                        sensor_msgs::image_encodings::TYPE_16UC1, header, info);
+            }
+
+        protected:
+            void convertRow(const uint8_t* src, uint8_t* dst, int width, const std::string& encoding) const override
+            {
+                depth_to_meters(reinterpret_cast<const uint16_t*>(src), reinterpret_cast<float*>(dst), width, _depth_unit);
+            }
+
+        private:
+            float _depth_unit;
+    };
+}
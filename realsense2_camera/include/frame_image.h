@@ -0,0 +1,129 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include <any_librealsense2/rs.hpp>
+#include <sensor_msgs/Image.h>
+
+#include <boost/shared_ptr.hpp>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+namespace realsense2_camera
+{
+    //* Allocator which lends the pixel buffer of a librealsense frame to a message container.
+    //* The frame handle is reference counted, so the buffer stays alive for as long as any
+    //* copy of the allocator (i.e. the message holding it) is alive. Only the first byte
+    //* container allocated through it borrows the frame; everything else (strings, copies,
+    //* growth beyond the frame size) falls back to the heap.
+    template <typename T>
+    class FrameBufferAllocator
+    {
+        public:
+            typedef T value_type;
+            typedef T* pointer;
+            typedef const T* const_pointer;
+            typedef std::size_t size_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef std::true_type propagate_on_container_move_assignment;
+            typedef std::true_type propagate_on_container_swap;
+
+            template <typename U>
+            struct rebind
+            {
+                typedef FrameBufferAllocator<U> other;
+            };
+
+            FrameBufferAllocator() = default;
+            explicit FrameBufferAllocator(rs2::frame frame) : _frame(frame) {}
+
+            template <typename U>
+            FrameBufferAllocator(const FrameBufferAllocator<U>& other) : _frame(other.frame()) {}
+
+            T* allocate(std::size_t n)
+            {
+                if (isBorrowable(n))
+                {
+                    return static_cast<T*>(const_cast<void*>(_frame.get_data()));
+                }
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            }
+
+            void deallocate(T* p, std::size_t)
+            {
+                if (!isBorrowed(p))
+                {
+                    ::operator delete(p);
+                }
+            }
+
+            //* Default-insertion into the borrowed buffer must not overwrite the pixels.
+            template <typename U>
+            void construct(U* p)
+            {
+                if (!isBorrowed(p))
+                {
+                    ::new(static_cast<void*>(p)) U();
+                }
+            }
+
+            template <typename U, typename... Args>
+            void construct(U* p, Args&&... args)
+            {
+                ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+            }
+
+            template <typename U>
+            void destroy(U* p)
+            {
+                p->~U();
+            }
+
+            //* Copies of a message must own their data.
+            FrameBufferAllocator select_on_container_copy_construction() const
+            {
+                return FrameBufferAllocator();
+            }
+
+            const rs2::frame& frame() const { return _frame; }
+
+        private:
+            bool isBorrowable(std::size_t n) const
+            {
+                return std::is_same<T, uint8_t>::value && _frame &&
+                       n * sizeof(T) <= static_cast<std::size_t>(_frame.get_data_size());
+            }
+
+            template <typename U>
+            bool isBorrowed(const U* p) const
+            {
+                if (!_frame)
+                    return false;
+                const uint8_t* begin = static_cast<const uint8_t*>(_frame.get_data());
+                const uint8_t* address = reinterpret_cast<const uint8_t*>(p);
+                return address >= begin && address < begin + _frame.get_data_size();
+            }
+
+            rs2::frame _frame;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const FrameBufferAllocator<T>& a, const FrameBufferAllocator<U>& b)
+    {
+        return a.frame().get() == b.frame().get();
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const FrameBufferAllocator<T>& a, const FrameBufferAllocator<U>& b)
+    {
+        return !(a == b);
+    }
+
+    //* sensor_msgs/Image whose data vector can borrow an rs2::frame buffer. It shares the MD5 sum
+    //* and wire format of sensor_msgs/Image, so remote subscribers are unaffected, while nodelets
+    //* subscribing with this type in the same manager receive the pixels without any copy.
+    typedef sensor_msgs::Image_<FrameBufferAllocator<void>> FrameImage;
+    typedef boost::shared_ptr<FrameImage> FrameImagePtr;
+    typedef boost::shared_ptr<const FrameImage> FrameImageConstPtr;
+}
@@ -0,0 +1,52 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/depth_deprojector.h"
+#include "../include/point_cloud_kernels.h"
+#include "../include/worker_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* 2.5D grid of the highest point of every cell, rasterized straight from depth images without
+    //* a point cloud. Every thread rasterizes a part of the image into a grid of its own; the grids
+    //* are then merged with max, so that no cell is shared while rasterizing.
+    class HeightMapBuilder
+    {
+        public:
+            //* area is {min_x, min_y, max_x, max_y} of the grid in meters, in the frame of the grid;
+            //* resolution is the edge of a cell in meters.
+            HeightMapBuilder(float resolution, const float area[4], int threads);
+
+            //* Transform of points from the depth optical frame to the frame of the grid (z up); the
+            //* rotation is row-major. Identity until set.
+            void setTransform(const float rotation[9], const float translation[3]);
+
+            float resolution() const { return _resolution; }
+            int width() const { return _width; }
+            int height() const { return _height; }
+            float originX() const { return _origin[0]; }
+            float originY() const { return _origin[1]; }
+
+            //* Writes the highest z of the points of every cell to max_heights, width() * height() values
+            //* row by row, or NaN for cells without points. Points outside crop (unless null) are left out.
+            void build(const DepthDeprojector& deprojector, const uint16_t* depth, float depth_unit,
+                       const crop_volume* crop, float* max_heights);
+
+        private:
+            void rasterize(const DepthDeprojector& deprojector, const uint16_t* depth, float depth_unit,
+                           const crop_volume* crop, std::size_t begin, std::size_t end, float* grid) const;
+
+            const float _resolution;
+            float _origin[2];
+            int _width;
+            int _height;
+            float _rotation[9];
+            float _translation[3];
+            WorkerPool _pool;
+            std::vector<std::vector<float>> _grids;
+    };
+}
@@ -0,0 +1,64 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/kernel_isa.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace realsense2_camera
+{
+    //* Name of the instruction set the image kernels dispatch to on this CPU (e.g. "AVX2").
+    const char* image_kernels_isa();
+
+    //* Makes the image kernels dispatch to isa instead of the detected one, so that tests can run
+    //* every variant. Returns false, changing nothing, if the CPU does not support isa. Not to be
+    //* called while kernels run.
+    bool set_image_kernels_isa(kernel_isa isa);
+
+    //* Converts depth values between units: dst = src * from_scale / to_scale, truncated.
+    //* Matches the scalar float computation bit by bit. src and dst may alias.
+    void rescale_depth(const uint16_t* src, uint16_t* dst, std::size_t count, float from_scale, float to_scale);
+
+    //* Zeroes depth values outside [min_value, max_value]. src and dst may alias.
+    void clip_depth_range(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value);
+
+    //* clip_depth_range() followed by rescale_depth(), in a single pass over the data.
+    void clip_rescale_depth(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value,
+                            float from_scale, float to_scale);
+
+    //* dst[i] = src[i] * scale as float, or NaN where src[i] is 0 (no depth).
+    void depth_to_meters(const uint16_t* src, float* dst, std::size_t count, float scale);
+
+    //* acc[i] += src[i]
+    void accumulate_row(const uint8_t* src, uint16_t* acc, std::size_t count);
+
+    //* acc[i] = smallest non-zero value of acc[i] and src[i], or 0 if both are 0.
+    void min_nonzero_row(const uint16_t* src, uint16_t* acc, std::size_t count);
+
+    //* min_nonzero_row() where src[i] only counts if it is within [min_values[i], max_values[i]];
+    //* min_values are at least 1.
+    void min_depth_in_range_row(const uint16_t* src, const uint16_t* min_values, const uint16_t* max_values,
+                                uint16_t* acc, std::size_t count);
+
+    //* Bins factor x factor blocks of an 8-bit image into one output row, averaging each channel.
+    //* src points to the first of the factor input rows; scratch holds out_width * factor * channels values.
+    void bin_row(const uint8_t* src, std::size_t src_stride, int factor, int out_width, int channels, uint16_t* scratch, uint8_t* dst);
+
+    //* Bins factor x factor blocks of a depth image into one output row, keeping the nearest valid
+    //* depth of each block. Values outside [min_value, max_value] are treated as invalid (0).
+    //* src_stride is in pixels; scratch holds 2 * out_width * factor values.
+    void bin_depth_row(const uint16_t* src, std::size_t src_stride, int factor, int out_width,
+                       uint16_t min_value, uint16_t max_value, uint16_t* scratch, uint16_t* dst);
+
+    //* Converts packed YUV 4:2:2 (YUYV, or UYVY if uyvy is set) to RGB8, or BGR8 if bgr is set,
+    //* with the BT.601 integer formula librealsense uses for its RGB8 output. pixel_count is even.
+    void yuv422_to_rgb(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy, bool bgr);
+
+    //* Extracts the luma of packed YUV 4:2:2 as MONO8.
+    void yuv422_to_mono(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy);
+
+    //* RGB of pixel x of a packed YUV 4:2:2 row, for sparse lookups.
+    void yuv422_pixel_to_rgb(const uint8_t* row, std::size_t x, bool uyvy, uint8_t* rgb);
+}
@@ -0,0 +1,145 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/derived_image_publisher.h"
+#include "../include/image_kernels.h"
+#include "../include/message_pool.h"
+#include "../include/subscriber_tracker.h"
+#include "../include/worker_pool.h"
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Publishes levels 1..n of the resolution pyramid of a depth (16UC1) or MONO8 image topic,
+    //* level l being 2^l times smaller. Depth keeps the nearest valid depth of every 2x2 block,
+    //* so that thin obstacles and holes survive; intensities are averaged.
+    //* Only the levels up to the coarsest subscribed one are computed, in a single pass over
+    //* tiles of rows: each tile produces its rows of every level while they are still in cache.
+    //* Tiles run on a pool of threads of its own.
+    class ImagePyramidPublisher : public DerivedImagePublisher
+    {
+        public:
+            struct Level
+            {
+                explicit Level(std::size_t pool_capacity) : subscribers(0), images(pool_capacity), infos(pool_capacity) {}
+
+                image_transport::Publisher image_publisher;
+                ros::Publisher info_publisher;
+                uint64_t subscribers;
+                MessagePool<sensor_msgs::Image> images;
+                MessagePool<sensor_msgs::CameraInfo> infos;
+            };
+
+            ImagePyramidPublisher(int level_count, int threads, const SubscriberTracker& tracker, std::size_t pool_capacity) :
+                _pool(std::max(threads, 1)), _tracker(tracker)
+            {
+                for (int l = 0; l < level_count; ++l)
+                {
+                    levels.emplace_back(new Level(pool_capacity));
+                }
+            }
+
+            bool canPublish(const std::string& encoding) const override
+            {
+                return encoding == sensor_msgs::image_encodings::TYPE_16UC1 || encoding == sensor_msgs::image_encodings::MONO8;
+            }
+
+            void publish(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                         const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) override
+            {
+                const uint64_t subscribed = _tracker.subscribed();
+                int count = 0;
+                for (int l = 0; l < static_cast<int>(levels.size()); ++l)
+                {
+                    if ((subscribed & levels[l]->subscribers) && (width >> (l + 1)) > 0 && (height >> (l + 1)) > 0)
+                        count = l + 1;
+                }
+                if (count == 0)
+                    return;
+
+                const bool is_depth = (encoding == sensor_msgs::image_encodings::TYPE_16UC1);
+                const int pixel_size = is_depth ? sizeof(uint16_t) : sizeof(uint8_t);
+                std::vector<sensor_msgs::ImagePtr> images(count);
+                for (int l = 0; l < count; ++l)
+                {
+                    sensor_msgs::ImagePtr& img = images[l];
+                    img = levels[l]->images.acquire();
+                    img->header = header;
+                    img->encoding = encoding;
+                    img->width = width >> (l + 1);
+                    img->height = height >> (l + 1);
+                    img->is_bigendian = false;
+                    img->step = img->width * pixel_size;
+                    img->data.resize(img->step * img->height);
+                }
+                build(data, width, height, step, is_depth, images);
+
+                const uint32_t binning_x = std::max<uint32_t>(info.binning_x, 1);
+                const uint32_t binning_y = std::max<uint32_t>(info.binning_y, 1);
+                for (int l = 0; l < count; ++l)
+                {
+                    if (!(subscribed & levels[l]->subscribers))
+                        continue;
+                    // The intrinsics stay those of the full image, like for regions of interest; binning
+                    // tells the scale of the level and roi the part of the full image it covers.
+                    sensor_msgs::CameraInfoPtr level_info = levels[l]->infos.acquire();
+                    *level_info = info;
+                    level_info->binning_x = binning_x << (l + 1);
+                    level_info->binning_y = binning_y << (l + 1);
+                    level_info->roi.width = images[l]->width * level_info->binning_x;
+                    level_info->roi.height = images[l]->height * level_info->binning_y;
+                    levels[l]->image_publisher.publish(images[l]);
+                    levels[l]->info_publisher.publish(level_info);
+                }
+            }
+
+            std::vector<std::unique_ptr<Level>> levels;
+
+        private:
+            void build(const uint8_t* data, int width, int height, int step, bool is_depth,
+                       const std::vector<sensor_msgs::ImagePtr>& images)
+            {
+                const int count = static_cast<int>(images.size());
+                // A tile gives at least one row of the coarsest level, and is not too small to be worth a task.
+                const int tile_rows = 1 << std::max(count, 4);
+                const int tiles = (height + tile_rows - 1) / tile_rows;
+                _pool.run(tiles, [&](int tile)
+                {
+                    std::vector<uint16_t> scratch(2 * width);
+                    // Rows 2r and 2r + 1 of a level give row r of the next one, so every level of a
+                    // tile only needs rows of the same tile.
+                    const uint8_t* src = data;
+                    int src_step = step;
+                    for (int l = 0; l < count; ++l)
+                    {
+                        sensor_msgs::Image& dst = *images[l];
+                        const int rows = tile_rows >> (l + 1);
+                        const int first = tile * rows;
+                        const int last = std::min<int>(first + rows, dst.height);
+                        for (int r = first; r < last; ++r)
+                        {
+                            const uint8_t* src_row = src + 2 * r * src_step;
+                            uint8_t* dst_row = dst.data.data() + r * dst.step;
+                            if (is_depth)
+                                bin_depth_row(reinterpret_cast<const uint16_t*>(src_row), src_step / sizeof(uint16_t), 2, dst.width,
+                                              0, std::numeric_limits<uint16_t>::max(), scratch.data(), reinterpret_cast<uint16_t*>(dst_row));
+                            else
+                                bin_row(src_row, src_step, 2, dst.width, 1, scratch.data(), dst_row);
+                        }
+                        src = dst.data.data();
+                        src_step = dst.step;
+                    }
+                });
+            }
+
+            WorkerPool _pool;
+            const SubscriberTracker& _tracker;
+    };
+}
@@ -0,0 +1,41 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/worker_pool.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* JPEG encoder (libjpeg-turbo) which splits the image into horizontal stripes and encodes
+    //* them concurrently. Every stripe starts at a restart marker, where decoders reset their
+    //* state, so the stripes are encoded as separate images and their entropy coded data is
+    //* concatenated into a single baseline JPEG which any decoder reads.
+    class JpegEncoder
+    {
+        public:
+            //* quality is 1-100; threads is the number of stripes encoded at the same time.
+            JpegEncoder(int quality, int threads);
+            ~JpegEncoder();
+
+            //* Encodings accepted by encode(): mono8, rgb8, bgr8, rgba8, bgra8 and packed YUV 4:2:2
+            //* (yuv422, yuv422_yuy2), which is converted to RGB one MCU row at a time.
+            static bool canEncode(const std::string& encoding);
+
+            //* Reads the pixels in place, rows being step bytes apart, and replaces the content of out
+            //* with the JPEG image. Returns false, logging the libjpeg error, if encoding failed.
+            bool encode(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                        std::vector<uint8_t>& out);
+
+        private:
+            struct Stripe;
+
+            const int _quality;
+            std::vector<std::unique_ptr<Stripe>> _stripes;
+            WorkerPool _pool;
+    };
+}
@@ -0,0 +1,63 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RS_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RS_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace realsense2_camera
+{
+    //* Instruction sets the SIMD kernels are written for. Kernels are compiled for all of them
+    //* (x86 variants with target attributes) and dispatch on the one detected at runtime.
+    enum class kernel_isa
+    {
+        scalar,
+        sse41,
+        avx2,
+        neon,
+    };
+
+    inline kernel_isa detect_kernel_isa()
+    {
+#if defined(RS_KERNELS_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return kernel_isa::avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return kernel_isa::sse41;
+        return kernel_isa::scalar;
+#elif defined(RS_KERNELS_NEON)
+        return kernel_isa::neon;
+#else
+        return kernel_isa::scalar;
+#endif
+    }
+
+    //* Whether kernels for isa can run on this CPU.
+    inline bool kernel_isa_supported(kernel_isa isa)
+    {
+        switch (isa)
+        {
+            case kernel_isa::scalar:
+                return true;
+#if defined(RS_KERNELS_X86)
+            case kernel_isa::sse41:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("sse4.1");
+            case kernel_isa::avx2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+#elif defined(RS_KERNELS_NEON)
+            case kernel_isa::neon:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+}
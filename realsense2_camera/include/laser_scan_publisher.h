@@ -0,0 +1,147 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/derived_image_publisher.h"
+#include "../include/image_kernels.h"
+#include "../include/message_pool.h"
+
+#include <ros/ros.h>
+#include <sensor_msgs/LaserScan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* sensor_msgs/LaserScan of a band of rows of a depth (16UC1) image topic, as depthimage_to_laserscan
+    //* computes it: every column gives the nearest depth within the range limits over the band, at
+    //* the angle of the column around the vertical axis. The scan is in frame_id, which has x
+    //* forward and z up like the depth frame. The geometry of the columns comes from the camera
+    //* info and is only recomputed when it changes.
+    class LaserScanPublisher : public DerivedImagePublisher
+    {
+        public:
+            //* row and height are in pixels of the full depth image, row being the center of the band
+            //* (negative for the row of the principal point); depth_unit is the unit of the depth in meters.
+            LaserScanPublisher(const std::string& frame_id, int row, int height, float range_min, float range_max,
+                               float depth_unit, std::size_t pool_capacity) :
+                _frame_id(frame_id), _row(row), _height(std::max(height, 1)), _range_min(range_min),
+                _range_max(range_max), _depth_unit(depth_unit), _first_row(0), _row_count(0), _messages(pool_capacity)
+            {}
+
+            bool canPublish(const std::string& encoding) const override
+            {
+                return encoding == sensor_msgs::image_encodings::TYPE_16UC1;
+            }
+
+            void publish(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                         const std_msgs::Header& header, const sensor_msgs::CameraInfo& info) override
+            {
+                updateGeometry(width, height, info);
+
+                _nearest.assign(width, 0);
+                for (int y = _first_row; y < _first_row + _row_count; ++y)
+                {
+                    min_depth_in_range_row(reinterpret_cast<const uint16_t*>(data + y * step), _min_depth.data(), _max_depth.data(),
+                                           _nearest.data(), width);
+                }
+
+                sensor_msgs::LaserScanPtr scan = _messages.acquire();
+                scan->header = header;
+                scan->header.frame_id = _frame_id;
+                scan->angle_min = _angle_min;
+                scan->angle_max = _angle_max;
+                scan->angle_increment = _angle_increment;
+                scan->time_increment = 0;
+                scan->scan_time = 0;
+                scan->range_min = _range_min;
+                scan->range_max = _range_max;
+                // Beams no column falls on are not measured (NaN); those of columns without a depth
+                // within the range limits have no return (+inf).
+                scan->ranges.assign(width, std::numeric_limits<float>::quiet_NaN());
+                for (int x = 0; x < width; ++x)
+                {
+                    const float column_range = _nearest[x] ? _nearest[x] * _depth_unit * _range_scale[x]
+                                                           : std::numeric_limits<float>::infinity();
+                    float& range = scan->ranges[_beams[x]];
+                    range = std::isnan(range) ? column_range : std::min(range, column_range);
+                }
+                publisher.publish(scan);
+            }
+
+            ros::Publisher publisher;
+
+        private:
+            // The image may be a binned region of the full image (see ImageRegion): pixel x covers the
+            // full image columns roi.x_offset + x * binning ... + binning - 1.
+            void updateGeometry(int width, int height, const sensor_msgs::CameraInfo& info)
+            {
+                const int binning_x = std::max<int>(info.binning_x, 1);
+                const int binning_y = std::max<int>(info.binning_y, 1);
+                const double key[] = {static_cast<double>(width), static_cast<double>(height), info.K[0], info.K[2], info.K[5],
+                                      static_cast<double>(info.roi.x_offset), static_cast<double>(info.roi.y_offset),
+                                      static_cast<double>(binning_x), static_cast<double>(binning_y)};
+                if (!_range_scale.empty() && std::equal(key, key + 9, _geometry_key))
+                    return;
+                std::copy(key, key + 9, _geometry_key);
+
+                const double center_row = (_row < 0) ? info.K[5] : _row;
+                const int band = std::max(_height / binning_y, 1);
+                const int row = static_cast<int>(std::floor((center_row - info.roi.y_offset) / binning_y)) - band / 2;
+                _first_row = std::min(std::max(row, 0), std::max(height - band, 0));
+                _row_count = std::min(band, height);
+
+                // Angle of a column around the vertical axis (positive to the left), and ratio of the
+                // range in the scan plane to the depth.
+                std::vector<double> angles(width);
+                _range_scale.resize(width);
+                _min_depth.resize(width);
+                _max_depth.resize(width);
+                for (int x = 0; x < width; ++x)
+                {
+                    const double column = info.roi.x_offset + x * binning_x + (binning_x - 1) / 2.0;
+                    const double ray_x = (column - info.K[2]) / info.K[0];
+                    angles[x] = std::atan2(-ray_x, 1.0);
+                    _range_scale[x] = static_cast<float>(std::sqrt(ray_x * ray_x + 1.0));
+                    const double meters_per_unit = _depth_unit * _range_scale[x];
+                    const double min_depth = std::max(std::ceil(_range_min / meters_per_unit), 1.0);
+                    const double max_depth = std::min(std::floor(_range_max / meters_per_unit), 65535.0);
+                    _min_depth[x] = (min_depth <= max_depth) ? static_cast<uint16_t>(min_depth) : 1;
+                    _max_depth[x] = (min_depth <= max_depth) ? static_cast<uint16_t>(max_depth) : 0;
+                }
+
+                // Columns are not evenly spaced in angle: each one goes to the nearest beam.
+                _angle_max = static_cast<float>(angles.front());
+                _angle_min = static_cast<float>(angles.back());
+                _angle_increment = (width > 1) ? (_angle_max - _angle_min) / (width - 1) : 0.f;
+                _beams.resize(width);
+                for (int x = 0; x < width; ++x)
+                {
+                    const long beam = (_angle_increment > 0) ? std::lround((angles[x] - _angle_min) / _angle_increment) : 0;
+                    _beams[x] = static_cast<int>(std::min(std::max(beam, 0L), static_cast<long>(width - 1)));
+                }
+            }
+
+            const std::string _frame_id;
+            const int _row;
+            const int _height;
+            const float _range_min;
+            const float _range_max;
+            const float _depth_unit;
+            double _geometry_key[9];
+            int _first_row;
+            int _row_count;
+            float _angle_min;
+            float _angle_max;
+            float _angle_increment;
+            std::vector<float> _range_scale;
+            std::vector<uint16_t> _min_depth;
+            std::vector<uint16_t> _max_depth;
+            std::vector<int> _beams;
+            std::vector<uint16_t> _nearest;
+            MessagePool<sensor_msgs::LaserScan> _messages;
+    };
+}
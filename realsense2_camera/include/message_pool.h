@@ -0,0 +1,75 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Fixed-size pool of recycled ROS messages.
+    //* The pool keeps a reference to every message it hands out. Once the publisher and all
+    //* subscribers have dropped theirs, the pool holds the only reference left and the message
+    //* (together with the capacity of its containers) is handed out again. After warm-up,
+    //* acquiring a message does not touch the heap.
+    template <typename M>
+    class MessagePool
+    {
+        public:
+            typedef boost::shared_ptr<M> MessagePtr;
+
+            explicit MessagePool(std::size_t capacity) :
+                _capacity(capacity), _hits(0), _misses(0)
+            {
+                _messages.reserve(capacity);
+            }
+
+            //* Allocates all messages of the pool upfront, so that no allocation happens while streaming.
+            void fill(const std::function<void(M&)>& init)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                while (_messages.size() < _capacity)
+                {
+                    MessagePtr message = boost::make_shared<M>();
+                    init(*message);
+                    _messages.push_back(message);
+                }
+            }
+
+            MessagePtr acquire()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                for (auto& message : _messages)
+                {
+                    if (message.unique())
+                    {
+                        ++_hits;
+                        return message;
+                    }
+                }
+                ++_misses;
+                MessagePtr message = boost::make_shared<M>();
+                if (_messages.size() < _capacity)
+                {
+                    _messages.push_back(message);
+                }
+                return message;
+            }
+
+            uint64_t hits() const { return _hits; }
+            uint64_t misses() const { return _misses; }
+
+        private:
+            std::mutex _mutex;
+            std::size_t _capacity;
+            std::vector<MessagePtr> _messages;
+            std::atomic<uint64_t> _hits;
+            std::atomic<uint64_t> _misses;
+    };
+}
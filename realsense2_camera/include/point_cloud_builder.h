@@ -0,0 +1,47 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/depth_deprojector.h"
+#include "../include/worker_pool.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Builds the records of point clouds made from depth images in parallel. The image is split
+    //* into tiles of pixels, which are processed in chunks small enough to stay in cache: a chunk
+    //* is deprojected, then handed to a function which finds its points and writes their records.
+    //* Unorganized clouds take two passes: tiles count their points, the exclusive prefix sum of
+    //* the counts gives the offset of every tile, and tiles then write their points straight to
+    //* their place in the output. Points keep the order of the pixels, whatever the tiling.
+    class PointCloudBuilder
+    {
+        public:
+            //* Pixels of a chunk, at most.
+            static const std::size_t CHUNK_SIZE = 1024;
+
+            //* Finds the points of count pixels starting at pixel begin, whose x, y, z are in vertices,
+            //* and returns their number. Unless out is null, also writes records at out: one per pixel
+            //* if ordered (with NaN for pixels without a point), otherwise one per point. It is called
+            //* from several threads, and twice per chunk for unorganized clouds (first with a null out),
+            //* so it has to find the same points every time.
+            typedef std::function<std::size_t(std::size_t begin, std::size_t count, const float* vertices, bool ordered,
+                                              uint8_t* out)> ChunkFunction;
+
+            explicit PointCloudBuilder(int threads);
+
+            int threads() const { return _pool.size(); }
+
+            //* Replaces data with the records, point_step bytes each, of the pixels of a depth image
+            //* deprojected by deprojector (one per pixel if ordered), and returns the number of records.
+            std::size_t build(const DepthDeprojector& deprojector, const uint16_t* depth, float depth_unit, std::size_t point_step,
+                              bool ordered, const ChunkFunction& chunk_function, std::vector<uint8_t>& data);
+
+        private:
+            WorkerPool _pool;
+            std::vector<std::size_t> _tile_offsets;
+    };
+}
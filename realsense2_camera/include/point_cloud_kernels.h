@@ -0,0 +1,74 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/kernel_isa.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace realsense2_camera
+{
+    //* Pixel layouts of point cloud textures.
+    enum class texture_format
+    {
+        rgb8,
+        mono8,
+        yuyv,
+        uyvy,
+    };
+
+    //* Volume of the points kept by crop_point_masks(): an axis-aligned box, tested on the points
+    //* transformed by rotation (row-major) and translation, limits of z, and limits of |x| / z and
+    //* |y| / z (tangents of the angles from the optical axis). Unused limits are infinite.
+    struct crop_volume
+    {
+        float rotation[9];
+        float translation[3];
+        float box_min[3];
+        float box_max[3];
+        float z_min;
+        float z_max;
+        float x_slope_max;
+        float y_slope_max;
+    };
+
+    //* Name of the instruction set the point cloud kernels dispatch to on this CPU (e.g. "AVX2").
+    const char* point_cloud_kernels_isa();
+
+    //* Makes the point cloud kernels dispatch to isa instead of the detected one, like
+    //* set_image_kernels_isa().
+    bool set_point_cloud_kernels_isa(kernel_isa isa);
+
+    //* x, y, z of count depth pixels, deprojected along rays of unit z: z is depth * depth_unit,
+    //* x and y are ray_x and ray_y times z. Zero depth gives (0, 0, 0). vertices holds 3 floats per pixel.
+    void deproject_depth(const uint16_t* depth, const float* ray_x, const float* ray_y, std::size_t count, float depth_unit, float* vertices);
+
+    //* Normals of count pixels of a width x height depth image, from pixel begin on, by central
+    //* differences of the points radius pixels left and right, above and below (ray_x and ray_y are
+    //* the rays of deproject_depth(), for the whole image). Normals face the camera. A pixel gets
+    //* NaN if it is closer than radius to the border, if it or one of its neighbours has no depth,
+    //* or if the depth of a neighbour differs from its own by more than max_depth_change * radius
+    //* times its depth (a depth discontinuity). normals holds 3 floats per pixel.
+    void depth_normals(const uint16_t* depth, const float* ray_x, const float* ray_y, int width, int height, int radius,
+                       float depth_unit, float max_depth_change, std::size_t begin, std::size_t count, float* normals);
+
+    //* Validity of count points of a point cloud: vertices holds x, y, z and
+    //* texcoords u, v per point. A point is valid if z > 0 and, if check_texture is set, u and v
+    //* are within [0, 1]. Bit i % 8 of masks[i / 8] is set for valid point i.
+    void valid_point_masks(const float* vertices, const float* texcoords, std::size_t count, bool check_texture, uint8_t* masks);
+
+    //* Clears the bits in masks (as set by valid_point_masks()) of the points out of crop.
+    void crop_point_masks(const float* vertices, std::size_t count, const crop_volume& crop, uint8_t* masks);
+
+    //* Colors of count points in a width x height texture, rows being packed, at texture
+    //* coordinates texcoords (u, v per point, within [0, 1] for points in the texture). A color is
+    //* the 4 bytes of the PointCloud2 rgb field (b, g, r, 0), or of the intensity field for mono8
+    //* (y, 0, 0, 0); it is 0 for points out of the texture. Packed YUV is converted to RGB.
+    void texture_colors(const float* texcoords, std::size_t count, const uint8_t* texture, int width, int height,
+                        texture_format format, uint32_t* colors);
+
+    //* Writes x, y, z of count points to records point_step (>= 16) bytes apart, followed by 4
+    //* zero bytes. Points whose bit in masks (as set by valid_point_masks()) is clear get NaN.
+    void write_point_records(const float* vertices, const uint8_t* masks, std::size_t count, uint8_t* out, std::size_t point_step);
+}
@@ -0,0 +1,73 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include <ros/time.h>
+
+#include <cstdint>
+
+namespace realsense2_camera
+{
+    //* Decides which frames of a topic are published: every n-th frame, and no more often than
+    //* a maximum rate. Rejecting a frame only updates a few counters, so callers check it before
+    //* doing any work on the frame.
+    class PublishThrottle
+    {
+        public:
+            PublishThrottle() : PublishThrottle(1, 0) {}
+
+            //* every_n <= 1 publishes every frame, max_rate <= 0 does not limit the rate.
+            PublishThrottle(int every_n, double max_rate) :
+                _every_n(every_n > 1 ? every_n : 1),
+                _period(max_rate > 0 ? 1.0 / max_rate : 0),
+                _count(0), _skipped(0), _next(0), _previous(0)
+            {}
+
+            bool isActive() const { return _every_n > 1 || _period > 0; }
+
+            bool accept(const ros::Time& t)
+            {
+                if (!isActive())
+                    return true;
+
+                if ((_count++ % _every_n) != 0)
+                {
+                    ++_skipped;
+                    return false;
+                }
+                if (_period > 0)
+                {
+                    const double now = t.toSec();
+                    // Accept a frame arriving up to half a frame interval early, so that jitter does not
+                    // make a rate which is a divisor of the frame rate skip an extra frame.
+                    const double tolerance = (_previous > 0 && now > _previous) ? 0.5 * (now - _previous) : 0;
+                    _previous = now;
+                    if (now + tolerance < _next)
+                    {
+                        ++_skipped;
+                        return false;
+                    }
+                    // Deadlines advance by whole periods to keep the average rate; after a gap, restart from now.
+                    _next = (now - _next > _period) ? now + _period : _next + _period;
+                }
+                return true;
+            }
+
+            uint64_t skipped() const { return _skipped; }
+
+            //* Publishing rate resulting from a given frame rate.
+            double expectedRate(double frame_rate) const
+            {
+                double rate = frame_rate / _every_n;
+                return (_period > 0 && 1.0 / _period < rate) ? 1.0 / _period : rate;
+            }
+
+        private:
+            uint64_t _every_n;
+            double _period;
+            uint64_t _count;
+            uint64_t _skipped;
+            double _next;
+            double _previous;
+    };
+}
@@ -0,0 +1,151 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/bounded_queue.h"
+
+#include <any_librealsense2/rs.hpp>
+#include <diagnostic_updater/diagnostic_updater.h>
+#include <ros/ros.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace realsense2_camera
+{
+    //* Runs the processing and publishing of frames on its own thread, so that librealsense
+    //* callbacks only enqueue a frame handle and return. When the worker falls behind, the queue
+    //* is bounded and frames are dropped according to the policy instead of stalling the device.
+    class PublishWorker
+    {
+        public:
+            enum class drop_policy {
+                drop_oldest,
+                drop_newest,
+            };
+
+            PublishWorker(const std::string& name, std::size_t capacity, drop_policy policy,
+                          std::function<void(rs2::frame)> callback, const std::string& hardware_id) :
+                _name(name), _queue(capacity), _policy(policy), _callback(callback),
+                _running(true), _sleeping(false), _pushed(0), _dropped(0),
+                _diagnostic_updater(ros::NodeHandle(), ros::NodeHandle("~"), ros::this_node::getName() + "_publish_queue_" + name)
+            {
+                _diagnostic_updater.setHardwareID(hardware_id);
+                _diagnostic_updater.add("Publish queue " + name, this, &PublishWorker::diagnostics);
+                _thread = std::thread([this]() { run(); });
+            }
+
+            ~PublishWorker()
+            {
+                stop();
+            }
+
+            //* Called from the librealsense callback. Never blocks.
+            void push(rs2::frame frame)
+            {
+                ++_pushed;
+                if (!_queue.tryPush(frame))
+                {
+                    bool dropped = true;
+                    if (_policy == drop_policy::drop_oldest)
+                    {
+                        // This is the only producer, so once the oldest frame is evicted (or the worker
+                        // took it meanwhile) there is room for the new one.
+                        rs2::frame oldest;
+                        dropped = _queue.tryPop(oldest);
+                        _queue.tryPush(frame);
+                    }
+                    if (dropped)
+                    {
+                        ++_dropped;
+                        ROS_WARN_THROTTLE(5, "Publish queue %s is full: %lu frames dropped so far.",
+                                          _name.c_str(), static_cast<unsigned long>(_dropped.load()));
+                    }
+                }
+                notify();
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _running = false;
+                }
+                _cv.notify_one();
+                if (_thread.joinable())
+                {
+                    _thread.join();
+                }
+            }
+
+            uint64_t dropped() const { return _dropped; }
+
+            void diagnostics(diagnostic_updater::DiagnosticStatusWrapper& status)
+            {
+                status.summary(0, "OK");
+                status.add("Capacity", _queue.capacity());
+                status.add("Frames received", _pushed.load());
+                status.add("Frames dropped", _dropped.load());
+            }
+
+        private:
+            void notify()
+            {
+                // Pairs with the fence in run(): either the worker sees the frame, or we see it sleeping.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (_sleeping.load(std::memory_order_relaxed))
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _cv.notify_one();
+                }
+            }
+
+            void run()
+            {
+                rs2::frame frame;
+                while (true)
+                {
+                    if (_queue.tryPop(frame))
+                    {
+                        try
+                        {
+                            _callback(frame);
+                        }
+                        catch(const std::exception& ex)
+                        {
+                            ROS_ERROR_STREAM("An error has occurred in publish queue " << _name << ": " << ex.what());
+                        }
+                        frame = rs2::frame();
+                        _diagnostic_updater.update();
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (!_running)
+                        break;
+                    _sleeping.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    _cv.wait(lock, [this]() { return !_running || !_queue.empty(); });
+                    _sleeping.store(false, std::memory_order_relaxed);
+                }
+            }
+
+            const std::string _name;
+            BoundedQueue<rs2::frame> _queue;
+            const drop_policy _policy;
+            std::function<void(rs2::frame)> _callback;
+
+            std::mutex _mutex;
+            std::condition_variable _cv;
+            bool _running;
+            std::atomic<bool> _sleeping;
+            std::atomic<uint64_t> _pushed;
+            std::atomic<uint64_t> _dropped;
+            diagnostic_updater::Updater _diagnostic_updater;
+            std::thread _thread;
+    };
+}
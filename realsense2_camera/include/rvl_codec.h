@@ -0,0 +1,50 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/worker_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Lossless compression of 16-bit depth images with RVL (A. Wilson, "Fast Lossless Depth Image
+    //* Compression", 2017): runs of zeros and of valid pixels are run-length coded, and valid pixels
+    //* are stored as zigzag deltas in variable-length nibbles.
+    //*
+    //* The image is split into bands of rows which are coded independently, so that they can be
+    //* encoded and decoded concurrently on a WorkerPool. Encoded layout, all fields little-endian uint32:
+    //*   magic "RVL1", width, height, band count, byte size of each band, then the bands.
+    //* Band i holds rows [height * i / count, height * (i + 1) / count).
+    namespace rvl
+    {
+        //* sensor_msgs/CompressedImage format string of RVL encoded depth.
+        const std::string FORMAT = "16UC1; rvl";
+
+        class Encoder
+        {
+            public:
+                //* band_count is clamped to [1, height] for every image; threads is the number of bands
+                //* encoded at the same time.
+                Encoder(int band_count, int threads);
+
+                //* Replaces the content of out with the encoded image.
+                void encode(const uint16_t* depth, int width, int height, std::vector<uint8_t>& out);
+
+            private:
+                int _band_count;
+                WorkerPool _pool;
+                // Bands are encoded at their worst case offsets, then packed into the output.
+                std::vector<uint8_t> _buffer;
+                std::vector<std::size_t> _band_sizes;
+        };
+
+        //* Returns false if the data is not a valid RVL image. depth is resized to width * height.
+        //* The bands are decoded on pool if given, otherwise one after another on the calling thread.
+        bool decode(const uint8_t* data, std::size_t size, std::vector<uint16_t>& depth, int& width, int& height,
+                    WorkerPool* pool = nullptr);
+    }
+}
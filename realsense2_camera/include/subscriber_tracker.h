@@ -0,0 +1,83 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include <ros/ros.h>
+#include <image_transport/image_transport.h>
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace realsense2_camera
+{
+    //* Keeps track of which published topics have subscribers, from the connect and disconnect
+    //* callbacks of their publishers. Querying it costs a single atomic load, unlike
+    //* getNumSubscribers(), which locks the publication.
+    //* Topics are identified by a bit; several publishers (e.g. an image, its camera info and
+    //* its transport plugins) may share one bit, which is set while any of them has a subscriber.
+    class SubscriberTracker
+    {
+        public:
+            SubscriberTracker() : _next_topic(1), _subscribed(0) {}
+
+            //* Reserves the bit of a new topic. At most 64 topics can be tracked.
+            uint64_t addTopic()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (0 == _next_topic)
+                {
+                    throw std::runtime_error("SubscriberTracker: too many topics");
+                }
+                uint64_t topic = _next_topic;
+                _next_topic <<= 1;
+                _counts[topic] = 0;
+                return topic;
+            }
+
+            ros::SubscriberStatusCallback connectCallback(uint64_t topic)
+            {
+                return [this, topic](const ros::SingleSubscriberPublisher&) { update(topic, 1); };
+            }
+
+            ros::SubscriberStatusCallback disconnectCallback(uint64_t topic)
+            {
+                return [this, topic](const ros::SingleSubscriberPublisher&) { update(topic, -1); };
+            }
+
+            image_transport::SubscriberStatusCallback imageConnectCallback(uint64_t topic)
+            {
+                return [this, topic](const image_transport::SingleSubscriberPublisher&) { update(topic, 1); };
+            }
+
+            image_transport::SubscriberStatusCallback imageDisconnectCallback(uint64_t topic)
+            {
+                return [this, topic](const image_transport::SingleSubscriberPublisher&) { update(topic, -1); };
+            }
+
+            //* Bitmap of the topics which currently have subscribers.
+            uint64_t subscribed() const { return _subscribed.load(std::memory_order_relaxed); }
+
+            //* Whether any of the given topics has subscribers. A mask of 0 never has.
+            bool hasSubscribers(uint64_t topics) const { return 0 != (subscribed() & topics); }
+
+        private:
+            void update(uint64_t topic, int delta)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                int& count = _counts[topic];
+                count += delta;
+                if (count > 0)
+                    _subscribed.fetch_or(topic, std::memory_order_relaxed);
+                else
+                    _subscribed.fetch_and(~topic, std::memory_order_relaxed);
+            }
+
+            std::mutex _mutex;
+            uint64_t _next_topic;
+            std::map<uint64_t, int> _counts;
+            std::atomic<uint64_t> _subscribed;
+    };
+}
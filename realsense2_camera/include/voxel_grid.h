@@ -0,0 +1,62 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include "../include/worker_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Voxel grid downsampling of point cloud records, which keeps one point per occupied voxel.
+    //* Voxels are found with hash tables; the points are partitioned by the hash of their voxel,
+    //* so that every thread owns the voxels of its partition and no table is shared.
+    class VoxelGrid
+    {
+        public:
+            enum class Policy
+            {
+                centroid,   //* Mean position and color of the points of the voxel.
+                first,      //* First point of the voxel, as is.
+            };
+
+            //* voxel_size is the edge of a voxel in meters; threads is the number of partitions
+            //* processed at the same time.
+            VoxelGrid(float voxel_size, Policy policy, int threads);
+
+            //* Replaces the records, point_step bytes each with x, y, z floats first, by one record
+            //* per voxel, and returns their number. With the centroid policy the 4 bytes at
+            //* color_offset are averaged byte by byte, unless color_offset is negative; the other
+            //* fields are those of the first point of the voxel.
+            std::size_t downsample(std::vector<uint8_t>& records, std::size_t point_step, int color_offset);
+
+        private:
+            struct Voxel
+            {
+                double sum[3];
+                uint32_t color_sum[4];
+                uint32_t count;
+                uint32_t first;
+            };
+
+            struct Partition
+            {
+                std::vector<uint64_t> keys;
+                std::vector<uint32_t> slots;
+                std::vector<Voxel> voxels;
+                std::size_t output = 0;
+            };
+
+            void accumulate(Partition& partition, int index, const uint8_t* records, std::size_t count,
+                            std::size_t point_step, int color_offset);
+
+            const float _inverse_size;
+            const Policy _policy;
+            WorkerPool _pool;
+            std::vector<Partition> _partitions;
+            std::vector<uint64_t> _keys;
+            std::vector<uint8_t> _owners;
+            std::vector<uint8_t> _output;
+    };
+}
@@ -0,0 +1,116 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace realsense2_camera
+{
+    //* Small fixed set of threads which run the iterations of a parallel loop. Unlike OpenMP, its
+    //* size is chosen per use, so a stage can be given a bounded number of cores. The calling
+    //* thread takes part in the loop, so a pool of n threads starts n - 1 threads of its own.
+    class WorkerPool
+    {
+        public:
+            explicit WorkerPool(int threads) :
+                _task(nullptr), _count(0), _next(0), _pending(0), _generation(0), _running(true)
+            {
+                for (int i = 1; i < threads; ++i)
+                {
+                    _threads.emplace_back([this]() { work(); });
+                }
+            }
+
+            ~WorkerPool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _running = false;
+                }
+                _start_cv.notify_all();
+                for (auto& thread : _threads)
+                {
+                    thread.join();
+                }
+            }
+
+            WorkerPool(const WorkerPool&) = delete;
+            WorkerPool& operator=(const WorkerPool&) = delete;
+
+            int size() const { return static_cast<int>(_threads.size()) + 1; }
+
+            //* Runs task(i) for every i in [0, count) and returns once all of them are done.
+            //* Tasks must not throw. Calls from different threads are serialized.
+            void run(int count, const std::function<void(int)>& task)
+            {
+                std::lock_guard<std::mutex> run_lock(_run_mutex);
+                if (_threads.empty() || count <= 1)
+                {
+                    for (int i = 0; i < count; ++i)
+                        task(i);
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _task = &task;
+                    _count = count;
+                    _next = 0;
+                    _pending = _threads.size();
+                    ++_generation;
+                }
+                _start_cv.notify_all();
+                runTasks(task, count);
+
+                // Every worker acknowledges the loop, so none of them can still see it on the next call.
+                std::unique_lock<std::mutex> lock(_mutex);
+                _done_cv.wait(lock, [this]() { return _pending == 0; });
+                _task = nullptr;
+            }
+
+        private:
+            void runTasks(const std::function<void(int)>& task, int count)
+            {
+                for (int i = _next++; i < count; i = _next++)
+                {
+                    task(i);
+                }
+            }
+
+            void work()
+            {
+                uint64_t generation = 0;
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (true)
+                {
+                    _start_cv.wait(lock, [&]() { return !_running || _generation != generation; });
+                    if (!_running)
+                        break;
+                    generation = _generation;
+                    const std::function<void(int)>* task = _task;
+                    const int count = _count;
+                    lock.unlock();
+                    runTasks(*task, count);
+                    lock.lock();
+                    if (--_pending == 0)
+                        _done_cv.notify_one();
+                }
+            }
+
+            std::vector<std::thread> _threads;
+            std::mutex _run_mutex;
+            std::mutex _mutex;
+            std::condition_variable _start_cv;
+            std::condition_variable _done_cv;
+            const std::function<void(int)>* _task;
+            int _count;
+            std::atomic<int> _next;
+            std::size_t _pending;
+            uint64_t _generation;
+            bool _running;
+    };
+}
@@ -4,6 +4,9 @@
 #include <boost/algorithm/string.hpp>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <mutex>
 
 using namespace any_realsense2_msgs;
@@ -130,6 +133,12 @@ BaseRealSenseNode::BaseRealSenseNode(ros::NodeHandle& nodeHandle,
 
 BaseRealSenseNode::~BaseRealSenseNode()
 {
+    // Stop publishing before the members used by the callbacks go away.
+    for (auto& worker : _publish_workers)
+    {
+        worker->stop();
+    }
+
     // Kill dynamic transform thread
     if (_publish_tf && _tf_publish_rate > 0)
         _tf_t->join();
@@ -184,6 +193,84 @@ void BaseRealSenseNode::setupErrorCallback()
     }
 }
 
+std::function<void(rs2::frame)> BaseRealSenseNode::queued(const std::string& name, std::function<void(rs2::frame)> callback, int queue_size)
+{
+    if (_publish_queue_size <= 0 || queue_size <= 0)
+    {
+        return callback;
+    }
+    std::string worker_name(name);
+    std::replace(worker_name.begin(), worker_name.end(), ' ', '_');
+    auto worker = std::make_shared<PublishWorker>(worker_name, queue_size, _publish_queue_policy, callback, _serial_no);
+    _publish_workers.push_back(worker);
+    return [worker](rs2::frame frame){ worker->push(frame); };
+}
+
+PublishThrottle BaseRealSenseNode::readPublishThrottle(const std::string& topic_name)
+{
+    int every_n;
+    double max_rate;
+    _pnh.param(topic_name + "_publish_every_n", every_n, PUBLISH_EVERY_N);
+    _pnh.param(topic_name + "_max_publish_rate", max_rate, MAX_PUBLISH_RATE);
+    PublishThrottle throttle(every_n, max_rate);
+    if (throttle.isActive())
+    {
+        ROS_INFO_STREAM("Publishing " << topic_name << ": every " << std::max(every_n, 1) << " frames"
+                        << ((max_rate > 0) ? ", at most " + std::to_string(max_rate) + " Hz" : "") << ".");
+    }
+    return throttle;
+}
+
+ImageRegion BaseRealSenseNode::readImageRegion(const std::string& topic_name)
+{
+    ImageRegion region;
+    _pnh.param(topic_name + "_roi_x_offset", region.x_offset, IMAGE_ROI_OFFSET);
+    _pnh.param(topic_name + "_roi_y_offset", region.y_offset, IMAGE_ROI_OFFSET);
+    _pnh.param(topic_name + "_roi_width", region.width, IMAGE_ROI_SIZE);
+    _pnh.param(topic_name + "_roi_height", region.height, IMAGE_ROI_SIZE);
+    _pnh.param(topic_name + "_binning", region.binning, IMAGE_BINNING);
+    if (region.x_offset < 0 || region.y_offset < 0 || region.width < 0 || region.height < 0 || region.binning < 1)
+    {
+        ROS_ERROR_STREAM("Invalid region of interest for " << topic_name << ": offsets and sizes must not be negative and binning must be"
+                         " at least 1; publishing the full image.");
+        return ImageRegion();
+    }
+    if (region.isActive())
+    {
+        ROS_INFO_STREAM("Publishing " << topic_name << ": region of interest at (" << region.x_offset << ", " << region.y_offset << "), size "
+                        << region.width << "x" << region.height << " (0 = up to the border), binning " << std::max(region.binning, 1) << ".");
+    }
+    return region;
+}
+
+// The size of the images is only known once their stream is enabled.
+ImageRegion BaseRealSenseNode::checkImageRegion(const std::string& topic_name, const ImageRegion& region, int width, int height,
+                                                bool pixel_pairs) const
+{
+    if (!region.isActive() || width <= 0 || height <= 0)
+        return region;
+    ImageRegion checked_region = region;
+    if (pixel_pairs && region.binning > 1)
+    {
+        ROS_WARN_STREAM("Binning is not supported for the packed YUV images of " << topic_name << "; publishing the region of interest unbinned.");
+        checked_region.binning = 1;
+    }
+    ImageRegion clamped_region = checked_region.clamped(width, height);
+    if (pixel_pairs)
+    {
+        // Two pixels share their chroma, so the region is widened to the pixel pairs it touches.
+        const int end = std::min(clamped_region.x_offset + clamped_region.width + 1, width) / 2 * 2;
+        clamped_region.x_offset -= clamped_region.x_offset % 2;
+        clamped_region.width = std::max(end - clamped_region.x_offset, 0);
+        checked_region = clamped_region;
+    }
+    if (clamped_region.outputWidth() > 0 && clamped_region.outputHeight() > 0)
+        return checked_region;
+    ROS_WARN_STREAM("The region of interest of " << topic_name << " at (" << region.x_offset << ", " << region.y_offset << "), binning "
+                    << region.binning << ", has no pixel in a " << width << "x" << height << " image; publishing the full image.");
+    return ImageRegion();
+}
+
 void BaseRealSenseNode::publishTopics()
 {
     getParameters();
@@ -533,6 +620,15 @@ void BaseRealSenseNode::getParameters()
     ROS_DEBUG("getParameters...");
 
     _pnh.param("align_depth", _align_depth, ALIGN_DEPTH);
+    if (_align_depth)
+    {
+        int align_depth_threads;
+        _pnh.param("align_depth_threads", align_depth_threads, ALIGN_DEPTH_THREADS);
+        _align_pool.reset(new WorkerPool(std::max(align_depth_threads, 1)));
+    }
+    int image_threads;
+    _pnh.param("image_threads", image_threads, IMAGE_THREADS);
+    _image_pool.reset(new WorkerPool(std::max(image_threads, 1)));
     _pnh.param("enable_pointcloud", _pointcloud, POINTCLOUD);
     std::string pc_texture_stream("");
     int pc_texture_idx;
@@ -598,7 +694,25 @@ void BaseRealSenseNode::getParameters()
         param_name = "enable_" + STREAM_NAME(stream);
         ROS_DEBUG_STREAM("reading parameter:" << param_name);
         _pnh.param(param_name, _enable[stream], true);
+        _image_throttles[stream] = readPublishThrottle(STREAM_NAME(stream));
+        _image_regions[stream] = readImageRegion(STREAM_NAME(stream));
+        if (stream.first == RS2_STREAM_DEPTH || stream.first == RS2_STREAM_INFRARED)
+        {
+            _pnh.param(STREAM_NAME(stream) + "_pyramid_levels", _pyramid_levels[stream], PYRAMID_LEVELS);
+            if (_pyramid_levels[stream] < 0)
+            {
+                ROS_ERROR_STREAM(STREAM_NAME(stream) << "_pyramid_levels must not be negative (" << _pyramid_levels[stream]
+                                 << "): no pyramid is published.");
+                _pyramid_levels[stream] = 0;
+            }
+        }
+        if (stream != DEPTH && stream.second < 2)
+        {
+            _depth_aligned_throttles[stream] = readPublishThrottle("aligned_depth_to_" + STREAM_NAME(stream));
+            _depth_aligned_image_regions[stream] = readImageRegion("aligned_depth_to_" + STREAM_NAME(stream));
+        }
     }
+    _pointcloud_throttle = readPublishThrottle("pointcloud");
 
     for (auto& stream : HID_STREAMS)
     {
@@ -647,7 +761,192 @@ void BaseRealSenseNode::getParameters()
     }
 
     _pnh.param("allow_no_texture_points", _allow_no_texture_points, ALLOW_NO_TEXTURE_POINTS);
+    _pnh.param("ordered_pc", _ordered_pc, ORDERED_PC);
+    if (_pointcloud)
+    {
+        int pointcloud_threads;
+        _pnh.param("pointcloud_threads", pointcloud_threads, POINTCLOUD_THREADS);
+        _pointcloud_builder.reset(new PointCloudBuilder(pointcloud_threads));
+    }
+    _pnh.param("pointcloud_normals", _pointcloud_normals, POINTCLOUD_NORMALS);
+    _pnh.param("pointcloud_normals_radius", _pointcloud_normals_radius, POINTCLOUD_NORMALS_RADIUS);
+    if (_pointcloud_normals && !_pointcloud)
+    {
+        ROS_WARN("pointcloud_normals is ignored: points_with_normals is built like the pointcloud, which is not enabled.");
+        _pointcloud_normals = false;
+    }
+    _pointcloud_normals_radius = std::max(_pointcloud_normals_radius, 1);
+    double voxel_size;
+    std::string voxel_policy;
+    int voxel_threads;
+    _pnh.param("pointcloud_voxel_size", voxel_size, POINTCLOUD_VOXEL_SIZE);
+    _pnh.param("pointcloud_voxel_policy", voxel_policy, POINTCLOUD_VOXEL_POLICY);
+    _pnh.param("pointcloud_voxel_threads", voxel_threads, POINTCLOUD_VOXEL_THREADS);
+    if (voxel_size > 0)
+    {
+        if (voxel_policy != "centroid" && voxel_policy != "first")
+        {
+            ROS_WARN_STREAM("Unknown pointcloud_voxel_policy " << voxel_policy << ", using " << POINTCLOUD_VOXEL_POLICY);
+            voxel_policy = POINTCLOUD_VOXEL_POLICY;
+        }
+        if (_ordered_pc)
+        {
+            ROS_WARN("ordered_pc is ignored: a voxel grid downsampled pointcloud is unorganized.");
+            _ordered_pc = false;
+        }
+        _voxel_grid.reset(new VoxelGrid(voxel_size, voxel_policy == "first" ? VoxelGrid::Policy::first : VoxelGrid::Policy::centroid, voxel_threads));
+    }
+
+    // Crop volume of the pointcloud, disabled by default: infinite limits and an identity transform.
+    std::string crop_frame;
+    std::vector<double> crop_box;
+    double crop_near, crop_far, crop_horizontal_fov, crop_vertical_fov;
+    _pnh.param("pointcloud_crop_frame", crop_frame, POINTCLOUD_CROP_FRAME);
+    _pnh.param("pointcloud_crop_box", crop_box, std::vector<double>());
+    _pnh.param("pointcloud_crop_near", crop_near, -1.0);
+    _pnh.param("pointcloud_crop_far", crop_far, -1.0);
+    _pnh.param("pointcloud_crop_horizontal_fov", crop_horizontal_fov, -1.0);
+    _pnh.param("pointcloud_crop_vertical_fov", crop_vertical_fov, -1.0);
+    const float inf = std::numeric_limits<float>::infinity();
+    _pointcloud_crop = crop_volume{{1, 0, 0, 0, 1, 0, 0, 0, 1}, {0, 0, 0}, {-inf, -inf, -inf}, {inf, inf, inf}, -inf, inf, inf, inf};
+    _pointcloud_crop_enabled = false;
+    if (crop_box.size() == 6)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            _pointcloud_crop.box_min[axis] = crop_box[axis];
+            _pointcloud_crop.box_max[axis] = crop_box[axis + 3];
+        }
+        _pointcloud_crop_enabled = true;
+    }
+    else if (!crop_box.empty())
+    {
+        ROS_WARN("pointcloud_crop_box is ignored: it holds min x, y, z then max x, y, z.");
+    }
+    if (crop_frame != "optical" && crop_frame != "base")
+    {
+        ROS_WARN_STREAM("Unknown pointcloud_crop_frame " << crop_frame << ", using " << POINTCLOUD_CROP_FRAME);
+        crop_frame = POINTCLOUD_CROP_FRAME;
+    }
+    _pointcloud_crop_in_base_frame = _pointcloud_crop_enabled && crop_frame == "base";
+    if (crop_near > 0)
+    {
+        _pointcloud_crop.z_min = crop_near;
+        _pointcloud_crop_enabled = true;
+    }
+    if (crop_far > 0)
+    {
+        _pointcloud_crop.z_max = crop_far;
+        _pointcloud_crop_enabled = true;
+    }
+    if (crop_horizontal_fov > 0)
+    {
+        _pointcloud_crop.x_slope_max = std::tan(std::min(crop_horizontal_fov, 179.9) * M_PI / 360);
+        _pointcloud_crop_enabled = true;
+    }
+    if (crop_vertical_fov > 0)
+    {
+        _pointcloud_crop.y_slope_max = std::tan(std::min(crop_vertical_fov, 179.9) * M_PI / 360);
+        _pointcloud_crop_enabled = true;
+    }
+
+    // Height map in base_frame_id: x forward, y left, z up. The default area is 4 m x 4 m in front of the camera.
+    bool height_map;
+    double height_map_resolution;
+    std::vector<double> height_map_area;
+    int height_map_threads;
+    _pnh.param("enable_height_map", height_map, HEIGHT_MAP);
+    _pnh.param("height_map_resolution", height_map_resolution, HEIGHT_MAP_RESOLUTION);
+    _pnh.param("height_map_area", height_map_area, std::vector<double>{0, -2, 4, 2});
+    _pnh.param("height_map_threads", height_map_threads, HEIGHT_MAP_THREADS);
+    if (height_map)
+    {
+        if (height_map_area.size() != 4 || height_map_area[2] <= height_map_area[0] || height_map_area[3] <= height_map_area[1])
+        {
+            ROS_WARN("height_map_area is ignored: it holds min x, y then max x, y.");
+            height_map_area = {0, -2, 4, 2};
+        }
+        if (height_map_resolution <= 0)
+        {
+            ROS_WARN_STREAM("height_map_resolution must be positive, using " << HEIGHT_MAP_RESOLUTION);
+            height_map_resolution = HEIGHT_MAP_RESOLUTION;
+        }
+        const float area[4] = {static_cast<float>(height_map_area[0]), static_cast<float>(height_map_area[1]),
+                               static_cast<float>(height_map_area[2]), static_cast<float>(height_map_area[3])};
+        _height_map.reset(new HeightMapBuilder(height_map_resolution, area, height_map_threads));
+    }
+    _pnh.param("zero_copy_images", _zero_copy_images, ZERO_COPY_IMAGES);
+    _pnh.param("depth_rvl_bands", _depth_rvl_bands, DEPTH_RVL_BANDS);
+    _pnh.param("depth_rvl_threads", _depth_rvl_threads, DEPTH_RVL_THREADS);
+    _pnh.param("jpeg_quality", _jpeg_quality, JPEG_QUALITY);
+    _pnh.param("jpeg_threads", _jpeg_threads, JPEG_THREADS);
+    _pnh.param("pyramid_threads", _pyramid_threads, PYRAMID_THREADS);
+    _pnh.param("enable_image_meters", _image_meters, IMAGE_METERS);
+    _pnh.param("enable_scan", _scan, SCAN);
+    _pnh.param("scan_row", _scan_row, SCAN_ROW);
+    _pnh.param("scan_height", _scan_height, SCAN_HEIGHT);
+    _pnh.param("scan_range_min", _scan_range_min, SCAN_RANGE_MIN);
+    _pnh.param("scan_range_max", _scan_range_max, SCAN_RANGE_MAX);
+    std::string color_format;
+    _pnh.param("color_format", color_format, COLOR_FORMAT);
+    if (color_format == "yuyv")
+    {
+        _format[RS2_STREAM_COLOR] = RS2_FORMAT_YUYV;
+        _image_format[RS2_STREAM_COLOR] = CV_8UC2;
+        _encoding[RS2_STREAM_COLOR] = YUV422_YUYV;
+        _unit_step_size[RS2_STREAM_COLOR] = 2;
+    }
+    else if (color_format == "uyvy")
+    {
+        _format[RS2_STREAM_COLOR] = RS2_FORMAT_UYVY;
+        _image_format[RS2_STREAM_COLOR] = CV_8UC2;
+        _encoding[RS2_STREAM_COLOR] = YUV422_UYVY;
+        _unit_step_size[RS2_STREAM_COLOR] = 2;
+    }
+    else if (color_format == "rgb8")
+    {
+        _format[RS2_STREAM_COLOR] = RS2_FORMAT_RGB8;
+    }
+    else
+    {
+        ROS_ERROR_STREAM("Unknown color_format " << color_format << "; expected rgb8, yuyv or uyvy. Using rgb8.");
+        _format[RS2_STREAM_COLOR] = RS2_FORMAT_RGB8;
+    }
+    _pnh.param("color_conversion_encoding", _color_conversion_encoding, COLOR_CONVERSION_ENCODING);
+    if (_color_conversion_encoding != sensor_msgs::image_encodings::RGB8 && _color_conversion_encoding != sensor_msgs::image_encodings::BGR8)
+    {
+        ROS_ERROR_STREAM("Unknown color_conversion_encoding " << _color_conversion_encoding << "; expected rgb8 or bgr8. Using rgb8.");
+        _color_conversion_encoding = sensor_msgs::image_encodings::RGB8;
+    }
     _pnh.param("clip_distance", _clipping_distance, static_cast<float>(-1.0));
+    _pnh.param("clip_distance_min", _clipping_distance_min, static_cast<float>(-1.0));
+    _pnh.param("publish_queue_size", _publish_queue_size, PUBLISH_QUEUE_SIZE);
+    std::string publish_queue_policy;
+    _pnh.param("publish_queue_policy", publish_queue_policy, PUBLISH_QUEUE_POLICY);
+    if (publish_queue_policy == "drop_newest")
+    {
+        _publish_queue_policy = PublishWorker::drop_policy::drop_newest;
+    }
+    else
+    {
+        if (publish_queue_policy != "drop_oldest")
+        {
+            ROS_WARN_STREAM("Invalid publish queue policy (" << publish_queue_policy << ")! drop_oldest will be used.");
+        }
+        _publish_queue_policy = PublishWorker::drop_policy::drop_oldest;
+    }
+    if (_publish_queue_size == 1)
+    {
+        ROS_WARN("publish_queue_size must be 0 (disabled) or at least 2. Using 2.");
+        _publish_queue_size = 2;
+    }
+    // IMU samples come at up to 400 Hz, in bursts: a queue sized for images would drop them.
+    _pnh.param("imu_publish_queue_size", _imu_publish_queue_size, IMU_PUBLISH_QUEUE_SIZE);
+    if (_imu_publish_queue_size == 1)
+    {
+        ROS_WARN("imu_publish_queue_size must be 0 (disabled) or at least 2. Using 2.");
+        _imu_publish_queue_size = 2;
+    }
     _pnh.param("linear_accel_cov", _linear_accel_cov, static_cast<double>(0.01));
     _pnh.param("angular_velocity_cov", _angular_velocity_cov, static_cast<double>(0.01));
     _pnh.param("hold_back_imu_for_frames", _hold_back_imu_for_frames, HOLD_BACK_IMU_FOR_FRAMES);
@@ -710,6 +1009,7 @@ void BaseRealSenseNode::setupDevice()
         ROS_INFO_STREAM("Point Cloud generation: '" <<  ((_pointcloud)?"On":"Off") << "';"
             << " Depth Alignment: '" <<  ((_align_depth)?"On":"Off") << "';"
             << " Frame synching: '" <<  ((_sync_frames)?"On":"Off") << "'.");
+        ROS_INFO_STREAM("Image kernels: " << image_kernels_isa());
 
         _dev_sensors = _dev.query_sensors();
 
@@ -722,7 +1022,7 @@ void BaseRealSenseNode::setupDevice()
             auto frame_callback_inner = [this](rs2::frame frame){
                 frame_callback(frame);
             };
-            _syncer.start(frame_callback_inner);
+            _syncer.start(queued("frames", frame_callback_inner, _publish_queue_size));
         }
         else
         {
@@ -739,6 +1039,11 @@ void BaseRealSenseNode::setupDevice()
         }
         std::function<void(rs2::frame)> multiple_message_callback_function = [this](rs2::frame frame){multiple_message_callback(frame, _imu_sync_method);};
 
+        // Every sensor gets its own publish queue, unless its frames go through the syncer, which has one.
+        auto video_callback_function = [&](const std::string& name) {
+            return _sync_frames ? frame_callback_function : queued(name, frame_callback_function, _publish_queue_size);
+        };
+
         ROS_DEBUG_STREAM("Device Sensors: ");
         for(auto&& elem : _dev_sensors)
         {
@@ -749,29 +1054,29 @@ void BaseRealSenseNode::setupDevice()
                 _sensors[DEPTH] = elem;
                 _sensors[INFRA1] = elem;
                 _sensors[INFRA2] = elem;
-                _sensors_callback[module_name] = frame_callback_function;
+                _sensors_callback[module_name] = video_callback_function(module_name);
             }
             else if ("Coded-Light Depth Sensor" == module_name)
             {
                 _sensors[DEPTH] = elem;
                 _sensors[INFRA1] = elem;
-                _sensors_callback[module_name] = frame_callback_function;
+                _sensors_callback[module_name] = video_callback_function(module_name);
             }
             else if ("RGB Camera" == module_name)
             {
                 _sensors[COLOR] = elem;
-                _sensors_callback[module_name] = frame_callback_function;
+                _sensors_callback[module_name] = video_callback_function(module_name);
             }
             else if ("Wide FOV Camera" == module_name)
             {
                 _sensors[FISHEYE] = elem;
-                _sensors_callback[module_name] = frame_callback_function;
+                _sensors_callback[module_name] = video_callback_function(module_name);
             }
             else if ("Motion Module" == module_name)
             {
                 _sensors[GYRO] = elem;
                 _sensors[ACCEL] = elem;
-                _sensors_callback[module_name] = imu_callback_function;
+                _sensors_callback[module_name] = queued(module_name, imu_callback_function, _imu_publish_queue_size);
             }
             else if ("Tracking Module" == module_name)
             {
@@ -780,7 +1085,7 @@ void BaseRealSenseNode::setupDevice()
                 _sensors[POSE] = elem;
                 _sensors[FISHEYE1] = elem;
                 _sensors[FISHEYE2] = elem;
-                _sensors_callback[module_name] = multiple_message_callback_function;
+                _sensors_callback[module_name] = queued(module_name, multiple_message_callback_function, _imu_publish_queue_size);
             }
             else
             {
@@ -817,7 +1122,21 @@ void BaseRealSenseNode::setupDevice()
 void BaseRealSenseNode::setupPublishers()
 {
     ROS_DEBUG("setupPublishers...");
+    for (auto& region : _image_regions)
+    {
+        region.second = checkImageRegion(STREAM_NAME(region.first), region.second, _width[region.first], _height[region.first],
+                                         isPackedYuv422(_encoding[region.first.first]));
+    }
+    for (auto& region : _depth_aligned_image_regions)
+    {
+        region.second = checkImageRegion("aligned_depth_to_" + STREAM_NAME(region.first), region.second,
+                                         _width[region.first], _height[region.first], false);
+    }
     image_transport::ImageTransport image_transport(_node_handle);
+    _pointcloud_subscribers = 0;
+    _normals_subscribers = 0;
+    _height_map_subscribers = 0;
+    _synced_imu_subscribers = 0;
 
     for (auto& stream : IMAGE_STREAMS)
     {
@@ -832,9 +1151,89 @@ void BaseRealSenseNode::setupPublishers()
             image_raw << stream_name << "/image_" << ((rectified_image)?"rect_":"") << "raw";
             camera_info << stream_name << "/camera_info";
 
-            std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_fps[stream], stream_name, _serial_no));
-            _image_publishers[stream] = {image_transport.advertise(image_raw.str(), 1), frequency_diagnostics};
-            _info_publisher[stream] = _node_handle.advertise<sensor_msgs::CameraInfo>(camera_info.str(), 1);
+            std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_image_throttles[stream].expectedRate(_fps[stream]), stream_name, _serial_no));
+            // The image and its camera info count as one output.
+            uint64_t topic = _subscribers.addTopic();
+            _image_subscribers[stream] = topic;
+            if (_zero_copy_images)
+            {
+                // The raw topic carries FrameImage messages, which borrow the librealsense buffer.
+                _image_publishers[stream] = {image_transport::Publisher(), frequency_diagnostics};
+                _zero_copy_image_publishers[stream] = _node_handle.advertise<FrameImage>(image_raw.str(), 1,
+                                                                                         _subscribers.connectCallback(topic),
+                                                                                         _subscribers.disconnectCallback(topic));
+            }
+            else
+            {
+                _image_publishers[stream] = {image_transport.advertise(image_raw.str(), 1,
+                                                                       _subscribers.imageConnectCallback(topic),
+                                                                       _subscribers.imageDisconnectCallback(topic)),
+                                             frequency_diagnostics};
+            }
+            _image_message_pools[stream] = createImageMessagePools(stream, _unit_step_size[stream.first], *frequency_diagnostics);
+            _info_publisher[stream] = _node_handle.advertise<sensor_msgs::CameraInfo>(camera_info.str(), 1,
+                                                                                      _subscribers.connectCallback(topic),
+                                                                                      _subscribers.disconnectCallback(topic));
+            if (stream == DEPTH)
+            {
+                advertiseCompressedImage(std::make_shared<RvlImagePublisher>(_depth_rvl_bands, _depth_rvl_threads, IMAGE_MESSAGE_POOL_SIZE),
+                                         image_raw.str() + "/rvl", _image_subscribers[stream], _derived_publishers[stream], *frequency_diagnostics);
+                if (_image_meters)
+                {
+                    advertiseConvertedImage(image_transport, std::make_shared<MetricDepthImagePublisher>(IMAGE_MESSAGE_POOL_SIZE),
+                                            stream_name + "/image_meters", _image_subscribers[stream], _derived_publishers[stream]);
+                }
+                if (_scan)
+                {
+                    // Made from the depth pixels like the other derived topics: the depth image is not published for it.
+                    auto scan = std::make_shared<LaserScanPublisher>(_frame_id[stream], _scan_row, _scan_height, _scan_range_min,
+                                                                     _scan_range_max, ROS_DEPTH_SCALE, IMAGE_MESSAGE_POOL_SIZE);
+                    scan->subscribers = _subscribers.addTopic();
+                    scan->publisher = _node_handle.advertise<sensor_msgs::LaserScan>("scan", 1,
+                                                                                     _subscribers.connectCallback(scan->subscribers),
+                                                                                     _subscribers.disconnectCallback(scan->subscribers));
+                    _image_subscribers[stream] |= scan->subscribers;
+                    _derived_publishers[stream].push_back(scan);
+                }
+            }
+            else if (stream == COLOR)
+            {
+                advertiseCompressedImage(std::make_shared<JpegImagePublisher>(_jpeg_quality, _jpeg_threads, IMAGE_MESSAGE_POOL_SIZE),
+                                         image_raw.str() + "/jpeg", _image_subscribers[stream], _derived_publishers[stream], *frequency_diagnostics);
+                if (isPackedYuv422(_encoding[stream.first]))
+                {
+                    // The raw topic carries the camera's YUV; RGB and grayscale are only converted for their subscribers.
+                    advertiseConvertedImage(image_transport,
+                                            std::make_shared<Yuv422ImagePublisher>(_color_conversion_encoding, IMAGE_MESSAGE_POOL_SIZE),
+                                            stream_name + "/image_color", _image_subscribers[stream], _derived_publishers[stream]);
+                    advertiseConvertedImage(image_transport,
+                                            std::make_shared<Yuv422ImagePublisher>(sensor_msgs::image_encodings::MONO8, IMAGE_MESSAGE_POOL_SIZE),
+                                            stream_name + "/image_mono", _image_subscribers[stream], _derived_publishers[stream]);
+                }
+            }
+
+            if (_pyramid_levels[stream] > 0)
+            {
+                // The coarsest level is at least 1 pixel wide and high, which also keeps the levels
+                // within the topics SubscriberTracker can count.
+                const ImageRegion region = _image_regions[stream].clamped(_width[stream], _height[stream]);
+                const int image_size = std::min(region.outputWidth(), region.outputHeight());
+                int max_levels = 0;
+                while ((image_size >> (max_levels + 1)) > 0)
+                    ++max_levels;
+                if (_pyramid_levels[stream] > max_levels)
+                {
+                    ROS_WARN_STREAM(stream_name << "_pyramid_levels is " << _pyramid_levels[stream] << ", but a "
+                                    << region.outputWidth() << "x" << region.outputHeight() << " image only has "
+                                    << max_levels << " levels: publishing " << max_levels << ".");
+                    _pyramid_levels[stream] = max_levels;
+                }
+            }
+            if (_pyramid_levels[stream] > 0)
+            {
+                advertisePyramid(image_transport, stream_name, std::string("image_") + ((rectified_image)?"rect_":"") + "raw",
+                                 _pyramid_levels[stream], _image_subscribers[stream], _derived_publishers[stream]);
+            }
 
             if (_align_depth && (stream != DEPTH) && stream.second < 2)
             {
@@ -843,42 +1242,99 @@ void BaseRealSenseNode::setupPublishers()
                 aligned_camera_info << "aligned_depth_to_" << stream_name << "/camera_info";
 
                 std::string aligned_stream_name = "aligned_depth_to_" + stream_name;
-                std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_fps[stream], aligned_stream_name, _serial_no));
-                _depth_aligned_image_publishers[stream] = {image_transport.advertise(aligned_image_raw.str(), 1), frequency_diagnostics};
-                _depth_aligned_info_publisher[stream] = _node_handle.advertise<sensor_msgs::CameraInfo>(aligned_camera_info.str(), 1);
+                std::shared_ptr<FrequencyDiagnostics> frequency_diagnostics(new FrequencyDiagnostics(_depth_aligned_throttles[stream].expectedRate(_fps[stream]),
+                                                                                                     aligned_stream_name, _serial_no));
+                uint64_t aligned_topic = _subscribers.addTopic();
+                _depth_aligned_image_subscribers[stream] = aligned_topic;
+                if (_zero_copy_images)
+                {
+                    _depth_aligned_image_publishers[stream] = {image_transport::Publisher(), frequency_diagnostics};
+                    _depth_aligned_zero_copy_image_publishers[stream] = _node_handle.advertise<FrameImage>(aligned_image_raw.str(), 1,
+                                                                                                           _subscribers.connectCallback(aligned_topic),
+                                                                                                           _subscribers.disconnectCallback(aligned_topic));
+                }
+                else
+                {
+                    _depth_aligned_image_publishers[stream] = {image_transport.advertise(aligned_image_raw.str(), 1,
+                                                                                         _subscribers.imageConnectCallback(aligned_topic),
+                                                                                         _subscribers.imageDisconnectCallback(aligned_topic)),
+                                                               frequency_diagnostics};
+                }
+                _depth_aligned_image_message_pools[stream] = createImageMessagePools(stream, _unit_step_size[DEPTH.first], *frequency_diagnostics);
+                _depth_aligned_times[stream] = std::make_shared<AlignmentTimes>();
+                frequency_diagnostics->diagnostic_updater_.add("Depth alignment", _depth_aligned_times[stream].get(), &AlignmentTimes::diagnostics);
+                _depth_aligned_info_publisher[stream] = _node_handle.advertise<sensor_msgs::CameraInfo>(aligned_camera_info.str(), 1,
+                                                                                                        _subscribers.connectCallback(aligned_topic),
+                                                                                                        _subscribers.disconnectCallback(aligned_topic));
+                advertiseCompressedImage(std::make_shared<RvlImagePublisher>(_depth_rvl_bands, _depth_rvl_threads, IMAGE_MESSAGE_POOL_SIZE),
+                                         aligned_image_raw.str() + "/rvl", _depth_aligned_image_subscribers[stream],
+                                         _depth_aligned_derived_publishers[stream], *frequency_diagnostics);
             }
 
             if (stream == DEPTH && _pointcloud)
             {
-                _pointcloud_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/color/points", 1);
+                _pointcloud_subscribers = _subscribers.addTopic();
+                _pointcloud_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/color/points", 1,
+                                                                                         _subscribers.connectCallback(_pointcloud_subscribers),
+                                                                                         _subscribers.disconnectCallback(_pointcloud_subscribers));
+                if (_pointcloud_normals)
+                {
+                    _normals_subscribers = _subscribers.addTopic();
+                    _normals_publisher = _node_handle.advertise<sensor_msgs::PointCloud2>("depth/points_with_normals", 1,
+                                                                                          _subscribers.connectCallback(_normals_subscribers),
+                                                                                          _subscribers.disconnectCallback(_normals_subscribers));
+                }
+            }
+            if (stream == DEPTH && _height_map)
+            {
+                // Made from the depth frame alone, whether or not the pointcloud is enabled.
+                _height_map_subscribers = _subscribers.addTopic();
+                _height_map_publisher = _node_handle.advertise<HeightMap>("height_map", 1,
+                                                                          _subscribers.connectCallback(_height_map_subscribers),
+                                                                          _subscribers.disconnectCallback(_height_map_subscribers));
             }
         }
     }
 
-    _timestamping_info_publisher = _node_handle.advertise<TimestampingInfoMsg>("camera_timestamping_info", 1);
+    _timestamping_info_subscribers = _subscribers.addTopic();
+    _timestamping_info_publisher = _node_handle.advertise<TimestampingInfoMsg>("camera_timestamping_info", 1,
+                                                                               _subscribers.connectCallback(_timestamping_info_subscribers),
+                                                                               _subscribers.disconnectCallback(_timestamping_info_subscribers));
 
     _synced_imu_publisher = std::make_shared<SyncedImuPublisher>();
     if (_imu_sync_method > imu_sync_method::NONE && _enable[GYRO] && _enable[ACCEL])
     {
         ROS_DEBUG("Start publisher IMU");
-        _synced_imu_publisher = std::make_shared<SyncedImuPublisher>(_node_handle.advertise<sensor_msgs::Imu>("imu", 5));
+        _synced_imu_subscribers = _subscribers.addTopic();
+        _synced_imu_publisher = std::make_shared<SyncedImuPublisher>(_node_handle.advertise<sensor_msgs::Imu>("imu", 5,
+                                                                                                              _subscribers.connectCallback(_synced_imu_subscribers),
+                                                                                                              _subscribers.disconnectCallback(_synced_imu_subscribers)));
         _synced_imu_publisher->Enable(_hold_back_imu_for_frames);
     }
     else
     {
         if (_enable[GYRO])
         {
-            _imu_publishers[GYRO] = _node_handle.advertise<sensor_msgs::Imu>("gyro/sample", 100);
+            _imu_subscribers[GYRO] = _subscribers.addTopic();
+            _imu_publishers[GYRO] = _node_handle.advertise<sensor_msgs::Imu>("gyro/sample", 100,
+                                                                             _subscribers.connectCallback(_imu_subscribers[GYRO]),
+                                                                             _subscribers.disconnectCallback(_imu_subscribers[GYRO]));
         }
 
         if (_enable[ACCEL])
         {
-            _imu_publishers[ACCEL] = _node_handle.advertise<sensor_msgs::Imu>("accel/sample", 100);
+            _imu_subscribers[ACCEL] = _subscribers.addTopic();
+            _imu_publishers[ACCEL] = _node_handle.advertise<sensor_msgs::Imu>("accel/sample", 100,
+                                                                              _subscribers.connectCallback(_imu_subscribers[ACCEL]),
+                                                                              _subscribers.disconnectCallback(_imu_subscribers[ACCEL]));
         }
     }
     if (_enable[POSE])
     {
-        _imu_publishers[POSE] = _node_handle.advertise<nav_msgs::Odometry>("odom/sample", 100);
+        _imu_subscribers[POSE] = _subscribers.addTopic();
+        _imu_publishers[POSE] = _node_handle.advertise<nav_msgs::Odometry>("odom/sample", 100,
+                                                                           _subscribers.connectCallback(_imu_subscribers[POSE]),
+                                                                           _subscribers.disconnectCallback(_imu_subscribers[POSE]));
     }
 
 
@@ -905,10 +1361,143 @@ void BaseRealSenseNode::setupPublishers()
     {
         _depth_to_other_extrinsics_publishers[INFRA2] = _node_handle.advertise<Extrinsics>("extrinsics/depth_to_infra2", 1, true);
     }
+
+    setupProcessingGraph();
+}
+
+void BaseRealSenseNode::setupProcessingGraph()
+{
+    // Stages which only exist in this configuration. Filters of the depth sensor also apply to the infrared streams.
+    bool has_depth_filters = std::any_of(_filters.begin(), _filters.end(), [](const NamedFilter& f) { return f._name != "pointcloud"; });
+    uint32_t clip_stage = (isDepthClipEnabled() && _clip_depth_in_place) ? STAGE_CLIP_DEPTH : 0;
+    uint32_t filter_stage = has_depth_filters ? STAGE_DEPTH_FILTERS : 0;
+
+    _processing_outputs.clear();
+    _always_required_stages = 0;
+    if (_timestamping_method == timestamping_method::varying_offsets)
+    {
+        // Timestamps of all outputs are corrected using the frame metadata.
+        _always_required_stages |= STAGE_METADATA;
+    }
+    _processing_outputs.push_back({"camera_timestamping_info", _timestamping_info_subscribers, STAGE_METADATA});
+
+    for (auto& image_subscribers : _image_subscribers)
+    {
+        const stream_index_pair stream = image_subscribers.first;
+        uint32_t stages = 0;
+        if (stream == DEPTH)
+            stages = clip_stage | filter_stage;
+        else if (stream == INFRA1 || stream == INFRA2)
+            stages = filter_stage;
+        _processing_outputs.push_back({STREAM_NAME(stream), image_subscribers.second, stages});
+    }
+
+    for (auto& image_subscribers : _depth_aligned_image_subscribers)
+    {
+        const stream_index_pair stream = image_subscribers.first;
+        _processing_outputs.push_back({"aligned_depth_to_" + STREAM_NAME(stream), image_subscribers.second,
+                                       clip_stage | filter_stage | STAGE_ALIGN_DEPTH});
+    }
+
+    if (_pointcloud)
+    {
+        _processing_outputs.push_back({"pointcloud", _pointcloud_subscribers, clip_stage | filter_stage | STAGE_POINTCLOUD});
+        if (_pointcloud_normals)
+            _processing_outputs.push_back({"points_with_normals", _normals_subscribers, clip_stage | filter_stage | STAGE_POINTCLOUD});
+    }
+    if (_height_map)
+    {
+        // The height map reads the depth frame, so it is clipped in place for it whatever the other outputs need.
+        uint32_t height_map_clip_stage = isDepthClipEnabled() ? STAGE_CLIP_DEPTH : 0;
+        _processing_outputs.push_back({"height_map", _height_map_subscribers, height_map_clip_stage | filter_stage | STAGE_HEIGHT_MAP});
+    }
+
+    for (auto& output : _processing_outputs)
+    {
+        ROS_DEBUG_STREAM("Processing stages of output " << output.name << ": 0x" << std::hex << output.stages);
+    }
+}
+
+uint32_t BaseRealSenseNode::requiredProcessingStages() const
+{
+    uint32_t stages = _always_required_stages;
+    uint64_t subscribed = _subscribers.subscribed();
+    for (auto& output : _processing_outputs)
+    {
+        if (subscribed & output.topics)
+        {
+            stages |= output.stages;
+        }
+    }
+    return stages;
+}
+
+std::shared_ptr<ImageMessagePools> BaseRealSenseNode::createImageMessagePools(const stream_index_pair& stream, int unit_step_size,
+                                                                                FrequencyDiagnostics& frequency_diagnostics)
+{
+    std::shared_ptr<ImageMessagePools> pools = std::make_shared<ImageMessagePools>(IMAGE_MESSAGE_POOL_SIZE);
+    const std::size_t image_size = _width[stream] * _height[stream] * unit_step_size;
+    pools->image.fill([image_size](sensor_msgs::Image& img) { img.data.reserve(image_size); });
+    pools->camera_info.fill([](sensor_msgs::CameraInfo& info) { info.D.reserve(5); });
+    frequency_diagnostics.diagnostic_updater_.add("Message pool", pools.get(), &ImageMessagePools::diagnostics);
+    return pools;
+}
+
+void BaseRealSenseNode::advertiseCompressedImage(const std::shared_ptr<CompressedImagePublisher>& publisher, const std::string& topic,
+                                                 uint64_t& image_subscribers, std::vector<std::shared_ptr<DerivedImagePublisher>>& derived_publishers,
+                                                 FrequencyDiagnostics& frequency_diagnostics)
+{
+    publisher->subscribers = _subscribers.addTopic();
+    publisher->publisher = _node_handle.advertise<sensor_msgs::CompressedImage>(topic, 1,
+                                                                                 _subscribers.connectCallback(publisher->subscribers),
+                                                                                 _subscribers.disconnectCallback(publisher->subscribers));
+    // The image has to be produced (and its camera info published) for either topic.
+    image_subscribers |= publisher->subscribers;
+    frequency_diagnostics.diagnostic_updater_.add(publisher->name() + " encoding", publisher.get(), &CompressedImagePublisher::diagnostics);
+    derived_publishers.push_back(publisher);
+}
+
+void BaseRealSenseNode::advertiseConvertedImage(image_transport::ImageTransport& image_transport,
+                                                const std::shared_ptr<ConvertedImagePublisher>& publisher,
+                                                const std::string& topic, uint64_t& image_subscribers,
+                                                std::vector<std::shared_ptr<DerivedImagePublisher>>& derived_publishers)
+{
+    publisher->subscribers = _subscribers.addTopic();
+    publisher->publisher = image_transport.advertise(topic, 1,
+                                                     _subscribers.imageConnectCallback(publisher->subscribers),
+                                                     _subscribers.imageDisconnectCallback(publisher->subscribers));
+    image_subscribers |= publisher->subscribers;
+    derived_publishers.push_back(publisher);
+}
+
+void BaseRealSenseNode::advertisePyramid(image_transport::ImageTransport& image_transport, const std::string& stream_name,
+                                         const std::string& image_name, int level_count, uint64_t& image_subscribers,
+                                         std::vector<std::shared_ptr<DerivedImagePublisher>>& derived_publishers)
+{
+    auto pyramid = std::make_shared<ImagePyramidPublisher>(level_count, _pyramid_threads, _subscribers, IMAGE_MESSAGE_POOL_SIZE);
+    for (int l = 0; l < level_count; ++l)
+    {
+        // Every level is a camera of its own, e.g. depth/level1/image_rect_raw and depth/level1/camera_info.
+        auto& level = *pyramid->levels[l];
+        std::string level_name = stream_name + "/level" + std::to_string(l + 1);
+        level.subscribers = _subscribers.addTopic();
+        level.image_publisher = image_transport.advertise(level_name + "/" + image_name, 1,
+                                                          _subscribers.imageConnectCallback(level.subscribers),
+                                                          _subscribers.imageDisconnectCallback(level.subscribers));
+        level.info_publisher = _node_handle.advertise<sensor_msgs::CameraInfo>(level_name + "/camera_info", 1,
+                                                                               _subscribers.connectCallback(level.subscribers),
+                                                                               _subscribers.disconnectCallback(level.subscribers));
+        pyramid->subscribers |= level.subscribers;
+    }
+    image_subscribers |= pyramid->subscribers;
+    derived_publishers.push_back(pyramid);
 }
 
 void BaseRealSenseNode::publishAlignedDepthToOthers(rs2::frameset frames, const ros::Time& t)
 {
+    // Every target stream has an align filter of its own, so that they can run at the same time.
+    std::vector<stream_index_pair> targets;
+    std::vector<std::shared_ptr<rs2::align>> aligns;
     for (auto it = frames.begin(); it != frames.end(); ++it)
     {
         auto frame = (*it);
@@ -923,31 +1512,60 @@ void BaseRealSenseNode::publishAlignedDepthToOthers(rs2::frameset frames, const
             continue;
         }
         stream_index_pair sip{stream_type, stream_index};
-        auto& info_publisher = _depth_aligned_info_publisher.at(sip);
-        auto& image_publisher = _depth_aligned_image_publishers.at(sip);
-
-        if(0 != info_publisher.getNumSubscribers() ||
-           0 != image_publisher.first.getNumSubscribers())
+        if (_subscribers.hasSubscribers(_depth_aligned_image_subscribers[sip]) && _depth_aligned_throttles[sip].accept(t))
         {
-            std::shared_ptr<rs2::align> align;
-            try{
-                align = _align.at(stream_type);
-            }
-            catch(const std::out_of_range& e)
+            std::shared_ptr<rs2::align>& align = _align[sip];
+            if (!align)
             {
                 ROS_DEBUG_STREAM("Allocate align filter for:" << rs2_stream_to_string(sip.first) << sip.second);
-                align = (_align[stream_type] = std::make_shared<rs2::align>(stream_type));
+                align = std::make_shared<rs2::align>(stream_type);
             }
-            rs2::frameset processed = frames.apply_filter(*align);
-            rs2::depth_frame aligned_depth_frame = processed.get_depth_frame();
+            targets.push_back(sip);
+            aligns.push_back(align);
+        }
+    }
+    if (targets.empty())
+        return;
+
+    // The alignments run on the pool and are joined before publishing, so that the depth is published
+    // after the slowest alignment rather than after all of them in turn.
+    std::vector<rs2::frame> aligned_frames(targets.size());
+    std::vector<double> times(targets.size());
+    std::vector<std::string> errors(targets.size());
+    _align_pool->run(static_cast<int>(targets.size()), [&](int i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            aligned_frames[i] = frames.apply_filter(*aligns[i]).as<rs2::frameset>().get_depth_frame();
+        }
+        catch (const std::exception& e)
+        {
+            errors[i] = e.what();
+        }
+        times[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    });
 
-            publishFrame(aligned_depth_frame, t, sip,
-                         _depth_aligned_image,
-                         _depth_aligned_info_publisher,
-                         _depth_aligned_image_publishers, _depth_aligned_seq,
-                         _depth_aligned_camera_info, _optical_frame_id,
-                         _depth_aligned_encoding);
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        const stream_index_pair& sip = targets[i];
+        if (!errors[i].empty() || !aligned_frames[i])
+        {
+            ROS_WARN_STREAM("Aligning depth to " << rs2_stream_to_string(sip.first) << sip.second << " failed: " << errors[i]);
+            continue;
         }
+        _depth_aligned_times[sip]->add(times[i]);
+        publishFrame(aligned_frames[i].as<rs2::depth_frame>(), t, sip,
+                     _depth_aligned_image,
+                     _depth_aligned_info_publisher,
+                     _depth_aligned_image_publishers,
+                     _depth_aligned_zero_copy_image_publishers,
+                     _depth_aligned_image_subscribers,
+                     _depth_aligned_image_regions,
+                     _depth_aligned_derived_publishers,
+                     _depth_aligned_image_message_pools, _depth_aligned_seq,
+                     _depth_aligned_camera_info, _optical_frame_id,
+                     _depth_aligned_encoding);
     }
 }
 
@@ -1005,7 +1623,6 @@ void BaseRealSenseNode::enable_devices()
 		for (auto& profiles : _enabled_profiles)
 		{
 			_depth_aligned_image[profiles.first] = cv::Mat(_height[DEPTH], _width[DEPTH], _image_format[DEPTH.first], cv::Scalar(0, 0, 0));
-			_depth_scaled_image[profiles.first] = cv::Mat(_height[DEPTH], _width[DEPTH], _image_format[DEPTH.first], cv::Scalar(0, 0, 0));
 		}
 	}
 
@@ -1112,10 +1729,10 @@ void BaseRealSenseNode::setupFilters()
         ROS_DEBUG("Add Filter: colorizer");
         _filters.push_back(NamedFilter("colorizer", std::make_shared<rs2::colorizer>()));
 
-        // Types for depth stream
-        _image_format[DEPTH.first] = _image_format[COLOR.first];    // CVBridge type
-        _encoding[DEPTH.first] = _encoding[COLOR.first]; // ROS message type
-        _unit_step_size[DEPTH.first] = _unit_step_size[COLOR.first]; // sensor_msgs::ImagePtr row step size
+        // Types for depth stream. The colorizer outputs RGB8, whatever the color stream format.
+        _image_format[DEPTH.first] = CV_8UC3;    // CVBridge type
+        _encoding[DEPTH.first] = sensor_msgs::image_encodings::RGB8; // ROS message type
+        _unit_step_size[DEPTH.first] = 3; // sensor_msgs::ImagePtr row step size
 
         _width[DEPTH] = _width[COLOR];
         _height[DEPTH] = _height[COLOR];
@@ -1124,76 +1741,134 @@ void BaseRealSenseNode::setupFilters()
     if (_pointcloud)
     {
     	ROS_DEBUG("Add Filter: pointcloud");
+        // Not applied to the frames: it holds the texture options of the point cloud, which are
+        // dynamically reconfigurable like those of the other filters.
         _filters.push_back(NamedFilter("pointcloud", std::make_shared<rs2::pointcloud>(_pointcloud_texture.first, _pointcloud_texture.second)));
     }
     ROS_DEBUG("num_filters: %d", static_cast<int>(_filters.size()));
+
+    // Filters and alignment consume the clipped depth frame, so it has to be clipped in place.
+    // Otherwise clipping is deferred and fused with the copy into the outgoing depth message.
+    _clip_depth_in_place = _align_depth || !_filters.empty();
 }
 
 
 
-cv::Mat& BaseRealSenseNode::fix_depth_scale(const cv::Mat& from_image, cv::Mat& to_image)
+bool BaseRealSenseNode::isDepthClipEnabled() const
+{
+    return _clipping_distance > 0 || _clipping_distance_min > 0;
+}
+
+void BaseRealSenseNode::depthClipRange(uint16_t& min_value, uint16_t& max_value) const
 {
-    static const float meter_to_mm = 0.001f;
-    if (fabs(_depth_scale_meters - meter_to_mm) < 1e-6)
+    // Depth values are kept if they lie within [min_value, max_value], in device units.
+    static const float max_depth_value = std::numeric_limits<uint16_t>::max();
+    min_value = 0;
+    max_value = std::numeric_limits<uint16_t>::max();
+    if (_clipping_distance_min > 0)
     {
-        to_image = from_image;
-        return to_image;
+        min_value = static_cast<uint16_t>(std::min(std::ceil(_clipping_distance_min / _depth_scale_meters), max_depth_value));
     }
-
-    if (to_image.size() != from_image.size())
+    if (_clipping_distance > 0)
     {
-        to_image.create(from_image.rows, from_image.cols, from_image.type());
+        max_value = static_cast<uint16_t>(std::min(_clipping_distance / _depth_scale_meters, max_depth_value));
     }
+}
 
-    CV_Assert(from_image.depth() == _image_format[RS2_STREAM_DEPTH]);
-
-    int nRows = from_image.rows;
-    int nCols = from_image.cols;
+void BaseRealSenseNode::clip_depth(rs2::depth_frame depth_frame)
+{
+    uint16_t* p_depth_frame = reinterpret_cast<uint16_t*>(const_cast<void*>(depth_frame.get_data()));
+    process_depth(p_depth_frame, depth_frame.get_width(), p_depth_frame, depth_frame.get_width(), depth_frame.get_height(), true, false);
+}
 
-    if (from_image.isContinuous())
-    {
-        nCols *= nRows;
-        nRows = 1;
-    }
+void BaseRealSenseNode::process_depth(const uint16_t* from, int from_stride, uint16_t* to, int width, int height, bool clip, bool rescale)
+{
+    static const float meter_to_mm = ROS_DEPTH_SCALE;
+    uint16_t min_value, max_value;
+    depthClipRange(min_value, max_value);
 
-    int i,j;
-    const uint16_t* p_from;
-    uint16_t* p_to;
-    for( i = 0; i < nRows; ++i)
+    forEachRowTile(height, [&](int begin, int end)
     {
-        p_from = from_image.ptr<uint16_t>(i);
-        p_to = to_image.ptr<uint16_t>(i);
-        for ( j = 0; j < nCols; ++j)
+        for (int y = begin; y < end; y++)
         {
-            p_to[j] = p_from[j] * _depth_scale_meters / meter_to_mm;
+            const uint16_t* from_row = from + y * from_stride;
+            uint16_t* to_row = to + y * width;
+            if (clip && rescale)
+                clip_rescale_depth(from_row, to_row, width, min_value, max_value, _depth_scale_meters, meter_to_mm);
+            else if (clip)
+                clip_depth_range(from_row, to_row, width, min_value, max_value);
+            else if (rescale)
+                rescale_depth(from_row, to_row, width, _depth_scale_meters, meter_to_mm);
+            else if (from_row != to_row)
+                memcpy(to_row, from_row, width * sizeof(uint16_t));
         }
-    }
-    return to_image;
+    });
 }
 
-void BaseRealSenseNode::clip_depth(rs2::depth_frame depth_frame, float clipping_dist)
+void BaseRealSenseNode::forEachRowTile(int height, const std::function<void(int begin, int end)>& tile_function)
 {
-    uint16_t* p_depth_frame = reinterpret_cast<uint16_t*>(const_cast<void*>(depth_frame.get_data()));
-    uint16_t clipping_value = static_cast<uint16_t>(clipping_dist / _depth_scale_meters);
+    // A few tiles per thread balance the load when a thread is held up.
+    const int tile_count = std::min(height, 4 * _image_pool->size());
+    _image_pool->run(tile_count, [&](int tile)
+    {
+        tile_function(height * tile / tile_count, height * (tile + 1) / tile_count);
+    });
+}
+
+void BaseRealSenseNode::copyImageRegion(const uint8_t* from, int from_width, int bpp, const ImageRegion& region,
+                                        bool is_depth, bool clip, bool rescale, uint8_t* to)
+{
+    const std::size_t from_step = static_cast<std::size_t>(from_width) * bpp;
+    const uint8_t* from_origin = from + region.y_offset * from_step + region.x_offset * bpp;
+    const int out_width = region.outputWidth();
+    const int out_height = region.outputHeight();
+    const std::size_t to_step = static_cast<std::size_t>(out_width) * bpp;
 
-    int width = depth_frame.get_width();
-    int height = depth_frame.get_height();
+    if (region.binning == 1)
+    {
+        if (is_depth)
+        {
+            process_depth(reinterpret_cast<const uint16_t*>(from_origin), from_width, reinterpret_cast<uint16_t*>(to),
+                          out_width, out_height, clip, rescale);
+            return;
+        }
+        forEachRowTile(out_height, [&](int begin, int end)
+        {
+            for (int y = begin; y < end; y++)
+            {
+                memcpy(to + y * to_step, from_origin + y * from_step, to_step);
+            }
+        });
+        return;
+    }
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule(dynamic) //Using OpenMP to try to parallelise the loop
-    #endif
-    for (int y = 0; y < height; y++)
+    // Every output row reads a band of binning input rows once, and is written once.
+    static const float meter_to_mm = ROS_DEPTH_SCALE;
+    uint16_t min_value = 0, max_value = std::numeric_limits<uint16_t>::max();
+    if (clip)
+        depthClipRange(min_value, max_value);
+    const int factor = region.binning;
+    const std::size_t scratch_size = static_cast<std::size_t>(out_width) * factor * (is_depth ? 2 : bpp);
+    forEachRowTile(out_height, [&](int begin, int end)
     {
-        auto depth_pixel_index = y * width;
-        for (int x = 0; x < width; x++, ++depth_pixel_index)
+        std::vector<uint16_t> scratch(scratch_size);
+        for (int y = begin; y < end; y++)
         {
-            // Check if the depth value is greater than the threashold
-            if (p_depth_frame[depth_pixel_index] > clipping_value)
+            const uint8_t* band = from_origin + y * factor * from_step;
+            if (is_depth)
             {
-                p_depth_frame[depth_pixel_index] = 0; //Set to invalid (<=0) value.
+                uint16_t* to_row = reinterpret_cast<uint16_t*>(to + y * to_step);
+                bin_depth_row(reinterpret_cast<const uint16_t*>(band), from_width, factor, out_width,
+                              min_value, max_value, scratch.data(), to_row);
+                if (rescale)
+                    rescale_depth(to_row, to_row, out_width, _depth_scale_meters, meter_to_mm);
+            }
+            else
+            {
+                bin_row(band, from_step, factor, out_width, bpp, scratch.data(), to + y * to_step);
             }
         }
-    }
+    });
 }
 
 sensor_msgs::Imu BaseRealSenseNode::CreateUnitedMessage(const CimuData accel_data, const CimuData gyro_data)
@@ -1311,7 +1986,7 @@ void BaseRealSenseNode::imu_callback_sync(rs2::frame frame, imu_sync_method sync
     seq += 1;
     double elapsed_camera_ms = (/*ms*/ frame_time - /*ms*/ _camera_time_base) / 1000.0;
 
-    if (0 != _synced_imu_publisher->getNumSubscribers())
+    if (_subscribers.hasSubscribers(_synced_imu_subscribers))
     {
         auto crnt_reading = *(reinterpret_cast<const float3*>(frame.get_data()));
         Eigen::Vector3d v(crnt_reading.x, crnt_reading.y, crnt_reading.z);
@@ -1358,7 +2033,7 @@ void BaseRealSenseNode::imu_callback(rs2::frame frame)
                 rs2_timestamp_domain_to_string(frame.get_frame_timestamp_domain()));
 
     auto stream_index = (stream == GYRO.first)?GYRO:ACCEL;
-    if (0 != _imu_publishers[stream_index].getNumSubscribers())
+    if (_subscribers.hasSubscribers(_imu_subscribers[stream_index]))
     {
         double elapsed_camera_ms = (/*ms*/ frame_time - /*ms*/ _camera_time_base) / 1000.0;
         ros::Time t(_ros_time_base.toSec() + elapsed_camera_ms);
@@ -1430,7 +2105,7 @@ void BaseRealSenseNode::pose_callback(rs2::frame frame)
 
     if (_publish_odom_tf) br.sendTransform(msg);
 
-    if (0 != _imu_publishers[stream_index].getNumSubscribers())
+    if (_subscribers.hasSubscribers(_imu_subscribers[stream_index]))
     {
         double cov_pose(_linear_accel_cov * pow(10, 3-(int)pose.tracker_confidence));
         double cov_twist(_angular_velocity_cov * pow(10, 1-(int)pose.tracker_confidence));
@@ -1582,7 +2257,7 @@ void BaseRealSenseNode::fetchFrameMetadata(const rs2::frame& frame, FrameMetadat
 }
 
 void BaseRealSenseNode::publishTimestampingInformation(const ros::Time& t, const rs2::frame& frame, const FrameMetadata& metadata, const TimeOffsets& time_offsets) {
-    if(0 != _timestamping_info_publisher.getNumSubscribers())
+    if (_subscribers.hasSubscribers(_timestamping_info_subscribers))
     {
         TimestampingInfoMsg msg;
 
@@ -1658,11 +2333,17 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
             setBaseTime(frame_time, RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME == frame.get_frame_timestamp_domain());
         }
 
+        //* Stages required by the outputs which currently have subscribers.
+        uint32_t stages = requiredProcessingStages();
+
         //* Metadata container.
         FrameMetadata frame_metadata;
 
         //* Fetch metadata from device.
-        fetchFrameMetadata(frame, frame_metadata);
+        if (stages & STAGE_METADATA)
+        {
+            fetchFrameMetadata(frame, frame_metadata);
+        }
 
         TimeOffsets timeOffsets;
 
@@ -1712,6 +2393,18 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
             ROS_DEBUG("Frameset arrived.");
             bool is_depth_arrived = false;
             auto frameset = frame.as<rs2::frameset>();
+            //* Skip computing the point cloud for framesets which would not be published. Only framesets
+            //* with the depth frame the point cloud is made of count for the throttle, so that framesets of
+            //* faster streams do not use it up.
+            if (stages & (STAGE_POINTCLOUD | STAGE_HEIGHT_MAP))
+            {
+                bool has_depth = std::any_of(frameset.begin(), frameset.end(), [] (rs2::frame f)
+                                             {return f.get_profile().stream_type() == RS2_STREAM_DEPTH && f.get_profile().format() == RS2_FORMAT_Z16; });
+                if (!has_depth || !_pointcloud_throttle.accept(t))
+                {
+                    stages &= ~(STAGE_POINTCLOUD | STAGE_HEIGHT_MAP);
+                }
+            }
             ROS_DEBUG("List of frameset before applying filters: size: %d", static_cast<int>(frameset.size()));
             for (auto it = frameset.begin(); it != frameset.end(); ++it)
             {
@@ -1725,16 +2418,24 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
                             rs2_stream_to_string(stream_type), stream_index, rs2_format_to_string(stream_format), stream_unique_id, frame.get_frame_number(), frame_time, t.toNSec());
                 runFirstFrameInitialization(stream_type);
             }
-            // Clip depth_frame for max range:
+            // Clip depth_frame for min and max range:
             rs2::depth_frame depth_frame = frameset.get_depth_frame();
-            if (depth_frame && _clipping_distance > 0)
+            if (depth_frame && (stages & STAGE_CLIP_DEPTH))
             {
-                clip_depth(depth_frame, _clipping_distance);
+                clip_depth(depth_frame);
             }
 
             ROS_DEBUG("num_filters: %d", static_cast<int>(_filters.size()));
             for (std::vector<NamedFilter>::const_iterator filter_it = _filters.begin(); filter_it != _filters.end(); filter_it++)
             {
+                // The point cloud is computed by publishPointCloud(), the filter only holds its options.
+                if (filter_it->_name == "pointcloud")
+                    continue;
+                if (!(stages & STAGE_DEPTH_FILTERS))
+                {
+                    ROS_DEBUG("Skipping filter: %s", filter_it->_name.c_str());
+                    continue;
+                }
                 ROS_DEBUG("Applying filter: %s", filter_it->_name.c_str());
                 frameset = filter_it->_filter->process(frameset);
             }
@@ -1760,7 +2461,6 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
             // As a workaround we remove the earlier one, the original one, assuming that if colorizer filter is
             // set it means that that's what the client wants.
             //
-            bool points_in_set(false);
             std::vector<rs2::frame> frames_to_publish;
             std::vector<stream_index_pair> is_in_set;
             for (auto it = frameset.begin(); it != frameset.end(); ++it)
@@ -1769,15 +2469,6 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
                 auto stream_type = f.get_profile().stream_type();
                 auto stream_index = f.get_profile().stream_index();
                 auto stream_format = f.get_profile().format();
-                if (f.is<rs2::points>())
-                {
-                    if (!points_in_set)
-                    {
-                        points_in_set = true;
-                        frames_to_publish.push_back(f);
-                    }
-                    continue;
-                }
                 stream_index_pair sip{stream_type,stream_index};
                 if (std::find(is_in_set.begin(), is_in_set.end(), sip) == is_in_set.end())
                 {
@@ -1800,26 +2491,50 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
                 ROS_DEBUG("Frameset contain (%s, %d, %s) frame. frame_number: %llu ; frame_TS: %f ; ros_TS(NSec): %lu",
                             rs2_stream_to_string(stream_type), stream_index, rs2_format_to_string(stream_format), frame.get_frame_number(), frame_time, t.toNSec());
 
-                if (f.is<rs2::points>())
+                stream_index_pair sip{stream_type,stream_index};
+                if (!_image_throttles[sip].accept(t))
                 {
-                    if (0 != _pointcloud_publisher.getNumSubscribers())
-                    {
-                        ROS_DEBUG("Publish pointscloud");
-                        publishPointCloud(f.as<rs2::points>(), t, frameset);
-                    }
                     continue;
                 }
-                stream_index_pair sip{stream_type,stream_index};
                 publishFrame(f, t,
                                 sip,
                                 _image,
                                 _info_publisher,
-                                _image_publishers, _seq,
+                                _image_publishers,
+                                _zero_copy_image_publishers,
+                                _image_subscribers,
+                                _image_regions,
+                                _derived_publishers,
+                                _image_message_pools, _seq,
                                 _camera_info, _optical_frame_id,
                                 _encoding);
             }
 
-            if (_align_depth && is_depth_arrived)
+            if (stages & (STAGE_POINTCLOUD | STAGE_HEIGHT_MAP))
+            {
+                // The depth frame, not its colorized version.
+                auto depth_itr = find_if(frameset.begin(), frameset.end(), [] (rs2::frame f)
+                                         {return f.get_profile().stream_type() == RS2_STREAM_DEPTH && f.get_profile().format() == RS2_FORMAT_Z16; });
+                if (depth_itr != frameset.end())
+                {
+                    if ((stages & STAGE_POINTCLOUD) && _subscribers.hasSubscribers(_pointcloud_subscribers))
+                    {
+                        ROS_DEBUG("Publish pointscloud");
+                        publishPointCloud((*depth_itr).as<rs2::depth_frame>(), t, frameset);
+                    }
+                    if ((stages & STAGE_POINTCLOUD) && _subscribers.hasSubscribers(_normals_subscribers))
+                    {
+                        ROS_DEBUG("Publish points with normals");
+                        publishPointsWithNormals((*depth_itr).as<rs2::depth_frame>(), t);
+                    }
+                    if ((stages & STAGE_HEIGHT_MAP) && _subscribers.hasSubscribers(_height_map_subscribers))
+                    {
+                        ROS_DEBUG("Publish height map");
+                        publishHeightMap((*depth_itr).as<rs2::depth_frame>(), t);
+                    }
+                }
+            }
+            if (_align_depth && is_depth_arrived && (stages & STAGE_ALIGN_DEPTH))
             {
                 ROS_DEBUG("publishAlignedDepthToOthers(...)");
                 publishAlignedDepthToOthers(frameset, t);
@@ -1834,20 +2549,35 @@ void BaseRealSenseNode::frame_callback(rs2::frame frame)
             runFirstFrameInitialization(stream_type);
 
             stream_index_pair sip{stream_type,stream_index};
-            if (frame.is<rs2::depth_frame>())
+            const bool publish_image = _image_throttles[sip].accept(t);
+            // Without frame syncing the height map is made from single depth frames.
+            const bool publish_height_map = (stages & STAGE_HEIGHT_MAP) && frame.is<rs2::depth_frame>() &&
+                                            frame.get_profile().format() == RS2_FORMAT_Z16 && _pointcloud_throttle.accept(t);
+            if (frame.is<rs2::depth_frame>() && isDepthClipEnabled() &&
+                ((publish_image && _clip_depth_in_place) || (publish_height_map && (stages & STAGE_CLIP_DEPTH))))
             {
-                if (_clipping_distance > 0)
-                {
-                    clip_depth(frame, _clipping_distance);
-                }
+                clip_depth(frame);
+            }
+            if (publish_image)
+            {
+                publishFrame(frame, t,
+                                sip,
+                                _image,
+                                _info_publisher,
+                                _image_publishers,
+                                _zero_copy_image_publishers,
+                                _image_subscribers,
+                                _image_regions,
+                                _derived_publishers,
+                                _image_message_pools, _seq,
+                                _camera_info, _optical_frame_id,
+                                _encoding);
+            }
+            if (publish_height_map)
+            {
+                ROS_DEBUG("Publish height map");
+                publishHeightMap(frame.as<rs2::depth_frame>(), t);
             }
-            publishFrame(frame, t,
-                            sip,
-                            _image,
-                            _info_publisher,
-                            _image_publishers, _seq,
-                            _camera_info, _optical_frame_id,
-                            _encoding);
         }
     }
     catch(const std::exception& ex)
@@ -2158,6 +2888,48 @@ void BaseRealSenseNode::publishStaticTransforms()
         _depth_to_other_extrinsics_publishers[INFRA2].publish(rsExtrinsicsToMsg(ex, frame_id));
     }
 
+    if (_enable[DEPTH] && (_pointcloud_crop_in_base_frame || _height_map))
+    {
+        setDepthToBaseTransform(base_profile);
+    }
+}
+
+void BaseRealSenseNode::setDepthToBaseTransform(const rs2::stream_profile& base_profile)
+{
+    // Same transform as the static transforms of the depth optical frame: extrinsics to the base
+    // stream, then from optical axes (x right, y down, z forward) to base_frame_id axes (x forward,
+    // y left, z up). It is used by the crop volume (in the base frame) and the height map.
+    rs2_extrinsics ex;
+    try
+    {
+        ex = getAProfile(DEPTH).get_extrinsics_to(base_profile);
+    }
+    catch (const std::exception& e)
+    {
+        ROS_WARN_STREAM(e.what() << " : using unity as depth to base extrinsics.");
+        ex = rs2_extrinsics({{1, 0, 0, 0, 1, 0, 0, 0, 1}, {0,0,0}});
+    }
+    // The rs2 rotation is column-major: row i of the rotation is rotation[i], rotation[i + 3], rotation[i + 6].
+    const int optical_axis[3] = {2, 0, 1};
+    const float optical_sign[3] = {1, -1, -1};
+    float rotation[9];
+    float translation[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const int row = optical_axis[axis];
+        for (int col = 0; col < 3; ++col)
+        {
+            rotation[3 * axis + col] = optical_sign[axis] * ex.rotation[row + 3 * col];
+        }
+        translation[axis] = optical_sign[axis] * ex.translation[row];
+    }
+    if (_pointcloud_crop_in_base_frame)
+    {
+        std::copy(rotation, rotation + 9, _pointcloud_crop.rotation);
+        std::copy(translation, translation + 3, _pointcloud_crop.translation);
+    }
+    if (_height_map)
+        _height_map->setTransform(rotation, translation);
 }
 
 void BaseRealSenseNode::publishDynamicTransforms()
@@ -2197,16 +2969,7 @@ void BaseRealSenseNode::publishIntrinsics()
     }
 }
 
-void reverse_memcpy(unsigned char* dst, const unsigned char* src, size_t n)
-{
-    size_t i;
-
-    for (i=0; i < n; ++i)
-        dst[n-1-i] = src[i];
-
-}
-
-void BaseRealSenseNode::publishPointCloud(rs2::points pc, const ros::Time& t, const rs2::frameset& frameset)
+void BaseRealSenseNode::publishPointCloud(const rs2::depth_frame& depth_frame, const ros::Time& t, const rs2::frameset& frameset)
 {
     std::vector<NamedFilter>::iterator pc_filter = find_if(_filters.begin(), _filters.end(), [] (NamedFilter s) { return s._name == "pointcloud"; } );
     rs2_stream texture_source_id = static_cast<rs2_stream>(pc_filter->_filter->get_option(rs2_option::RS2_OPTION_STREAM_FILTER));
@@ -2216,7 +2979,8 @@ void BaseRealSenseNode::publishPointCloud(rs2::points pc, const ros::Time& t, co
     rs2::frameset::iterator texture_frame_itr = frameset.end();
     if (use_texture)
     {
-        std::set<rs2_format> available_formats{ rs2_format::RS2_FORMAT_RGB8, rs2_format::RS2_FORMAT_Y8 };
+        std::set<rs2_format> available_formats{ rs2_format::RS2_FORMAT_RGB8, rs2_format::RS2_FORMAT_Y8,
+                                                rs2_format::RS2_FORMAT_YUYV, rs2_format::RS2_FORMAT_UYVY };
         
         texture_frame_itr = find_if(frameset.begin(), frameset.end(), [&texture_source_id, &available_formats] (rs2::frame f) 
                                 {return (rs2_stream(f.get_profile().stream_type()) == texture_source_id) &&
@@ -2231,117 +2995,220 @@ void BaseRealSenseNode::publishPointCloud(rs2::points pc, const ros::Time& t, co
         warn_count = 0;
     }
 
-    int texture_width(0), texture_height(0);
-    int num_colors(0);
-
-    const rs2::vertex* vertex = pc.get_vertices();
-    const rs2::texture_coordinate* color_point = pc.get_texture_coordinates();
-    std::list<unsigned int> valid_indices;
-    for (size_t point_idx=0; point_idx < pc.size(); point_idx++, vertex++, color_point++)
-    {
-        if (static_cast<float>(vertex->z) > 0)
-        {
-            float i = static_cast<float>(color_point->u);
-            float j = static_cast<float>(color_point->v);
-            if (_allow_no_texture_points || (i >= 0.f && i <= 1.f && j >= 0.f && j <= 1.f))
-            {
-                valid_indices.push_back(point_idx);
-            }
-        }
-    }
-
     sensor_msgs::PointCloud2 msg_pointcloud;
     msg_pointcloud.header.stamp = t;
     msg_pointcloud.header.frame_id = _optical_frame_id[DEPTH];
-    msg_pointcloud.width = valid_indices.size();
     msg_pointcloud.height = 1;
     msg_pointcloud.is_dense = true;
 
     sensor_msgs::PointCloud2Modifier modifier(msg_pointcloud);
     modifier.setPointCloud2FieldsByString(1, "xyz");    
 
-    vertex = pc.get_vertices();
+    int texture_width(0), texture_height(0);
+    rs2_intrinsics texture_intrinsics;
+    rs2_extrinsics depth_to_texture;
+    const uint8_t* color_data = nullptr;
+    // Packed YUV textures are converted to RGB for the sampled pixels only.
+    texture_format color_format = texture_format::rgb8;
+    std::size_t color_offset = 0;
     if (use_texture)
     {
         rs2::video_frame texture_frame = (*texture_frame_itr).as<rs2::video_frame>();
         texture_width = texture_frame.get_width();
         texture_height = texture_frame.get_height();
-        num_colors = texture_frame.get_bytes_per_pixel();
-        uint8_t* color_data = (uint8_t*)texture_frame.get_data();
+        color_data = (const uint8_t*)texture_frame.get_data();
+        texture_intrinsics = texture_frame.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+        stream_index_pair texture_stream{texture_frame.get_profile().stream_type(), texture_frame.get_profile().stream_index()};
+        auto extrinsics_itr = _depth_to_other_extrinsics.find(texture_stream);
+        depth_to_texture = (extrinsics_itr != _depth_to_other_extrinsics.end()) ?
+                           extrinsics_itr->second : depth_frame.get_profile().get_extrinsics_to(texture_frame.get_profile());
         std::string format_str;
         switch(texture_frame.get_profile().format())
         {
             case RS2_FORMAT_RGB8:
                 format_str = "rgb";
                 break;
+            case RS2_FORMAT_YUYV:
+                format_str = "rgb";
+                color_format = texture_format::yuyv;
+                break;
+            case RS2_FORMAT_UYVY:
+                format_str = "rgb";
+                color_format = texture_format::uyvy;
+                break;
             case RS2_FORMAT_Y8:
                 format_str = "intensity";
+                color_format = texture_format::mono8;
                 break;
             default:
                 throw std::runtime_error("Unhandled texture format passed in pointcloud " + std::to_string(texture_frame.get_profile().format()));
         }
         msg_pointcloud.point_step = addPointField(msg_pointcloud, format_str.c_str(), 1, sensor_msgs::PointField::FLOAT32, msg_pointcloud.point_step);
-        msg_pointcloud.row_step = msg_pointcloud.width * msg_pointcloud.point_step;
-        msg_pointcloud.data.resize(msg_pointcloud.height * msg_pointcloud.row_step);
-
-        sensor_msgs::PointCloud2Iterator<float>iter_x(msg_pointcloud, "x");
-        sensor_msgs::PointCloud2Iterator<float>iter_y(msg_pointcloud, "y");
-        sensor_msgs::PointCloud2Iterator<float>iter_z(msg_pointcloud, "z");
-        sensor_msgs::PointCloud2Iterator<uint8_t>iter_color(msg_pointcloud, format_str);
-        color_point = pc.get_texture_coordinates();
-
-        float color_pixel[2];
-        unsigned int prev_idx(0);
-        for (auto idx=valid_indices.begin(); idx != valid_indices.end(); idx++)
-        {
-            unsigned int idx_jump(*idx-prev_idx);
-            prev_idx = *idx;
-            vertex+=idx_jump;
-            color_point+=idx_jump;
-
-            *iter_x = vertex->x;
-            *iter_y = vertex->y;
-            *iter_z = vertex->z;
-
-            float i(color_point->u);
-            float j(color_point->v);
-            if (i >= 0.f && i <= 1.f && j >= 0.f && j <= 1.f)
+        color_offset = msg_pointcloud.fields.back().offset;
+    }
+
+    // The depth image is built in parallel by PointCloudBuilder. A chunk of pixels gets its texture
+    // coordinates and colors computed if there is a texture and its validity (including the crop
+    // volume) computed with SIMD, then its points are written out while the chunk is in cache.
+    auto depth_profile = depth_frame.get_profile().as<rs2::video_stream_profile>();
+    _deprojector.setIntrinsics(depth_profile.get_intrinsics());
+    const uint16_t* depth = reinterpret_cast<const uint16_t*>(depth_frame.get_data());
+    const float depth_unit = depth_frame.get_units();
+    const bool check_texture = use_texture && !_allow_no_texture_points;
+    const std::size_t point_step = msg_pointcloud.point_step;
+
+    auto build_chunk = [&](std::size_t begin, std::size_t count, const float* vertices, bool ordered, uint8_t* out)
+    {
+        float texcoords[2 * PointCloudBuilder::CHUNK_SIZE];
+        uint32_t colors[PointCloudBuilder::CHUNK_SIZE];
+        uint8_t masks[PointCloudBuilder::CHUNK_SIZE / 8];
+        // Colors are only needed to write the points; counting them only needs the texture
+        // coordinates if points out of the texture are dropped.
+        if (check_texture || (out && use_texture))
+            DepthDeprojector::projectToTexture(vertices, count, depth_to_texture, texture_intrinsics, texcoords);
+        valid_point_masks(vertices, texcoords, count, check_texture, masks);
+        if (_pointcloud_crop_enabled)
+            crop_point_masks(vertices, count, _pointcloud_crop, masks);
+        std::size_t points = 0;
+        for (std::size_t byte = 0; byte < (count + 7) / 8; ++byte)
+            points += __builtin_popcount(masks[byte]);
+        if (!out)
+            return points;
+        if (use_texture)
+            texture_colors(texcoords, count, color_data, texture_width, texture_height, color_format, colors);
+
+        if (ordered)
+        {
+            // Colors are written for valid points only; the message data is zero-initialized.
+            write_point_records(vertices, masks, count, out, point_step);
+            if (use_texture)
             {
-                color_pixel[0] = i * texture_width;
-                color_pixel[1] = j * texture_height;
-                int pixx = static_cast<int>(color_pixel[0]);
-                int pixy = static_cast<int>(color_pixel[1]);
-                int offset = (pixy * texture_width + pixx) * num_colors;
-                reverse_memcpy(&(*iter_color), color_data+offset, num_colors);  // PointCloud2 order of rgb is bgr.
+                for (std::size_t byte = 0; byte < (count + 7) / 8; ++byte)
+                {
+                    for (unsigned int bits = masks[byte]; bits != 0; bits &= bits - 1)
+                    {
+                        const std::size_t offset = byte * 8 + __builtin_ctz(bits);
+                        memcpy(out + offset * point_step + color_offset, colors + offset, sizeof(uint32_t));
+                    }
+                }
             }
-
-            ++iter_x; ++iter_y; ++iter_z;
-            ++iter_color;
+            return points;
         }
-    }
-    else
-    {
-        sensor_msgs::PointCloud2Iterator<float>iter_x(msg_pointcloud, "x");
-        sensor_msgs::PointCloud2Iterator<float>iter_y(msg_pointcloud, "y");
-        sensor_msgs::PointCloud2Iterator<float>iter_z(msg_pointcloud, "z");
-        unsigned int prev_idx(0);
-        for (auto idx=valid_indices.begin(); idx != valid_indices.end(); idx++)
+        for (std::size_t byte = 0; byte < (count + 7) / 8; ++byte)
         {
-            unsigned int idx_jump(*idx-prev_idx);
-            prev_idx = *idx;
-            vertex+=idx_jump;
-
-            *iter_x = vertex->x;
-            *iter_y = vertex->y;
-            *iter_z = vertex->z;
-
-            ++iter_x; ++iter_y; ++iter_z;
+            for (unsigned int bits = masks[byte]; bits != 0; bits &= bits - 1)
+            {
+                const std::size_t offset = byte * 8 + __builtin_ctz(bits);
+                const float record[4] = {vertices[3 * offset], vertices[3 * offset + 1], vertices[3 * offset + 2], 0.f};
+                memcpy(out, record, sizeof(record));
+                if (use_texture)
+                    memcpy(out + color_offset, colors + offset, sizeof(uint32_t));
+                out += point_step;
+            }
         }
+        return points;
+    };
+
+    buildPointCloud(msg_pointcloud, depth, depth_unit, depth_profile.width(), depth_profile.height(), _ordered_pc, build_chunk);
+    if (!_ordered_pc && _voxel_grid)
+    {
+        msg_pointcloud.width = _voxel_grid->downsample(msg_pointcloud.data, point_step, use_texture ? static_cast<int>(color_offset) : -1);
+        msg_pointcloud.row_step = msg_pointcloud.width * msg_pointcloud.point_step;
     }
+
     _pointcloud_publisher.publish(msg_pointcloud);
 }
 
 
+void BaseRealSenseNode::buildPointCloud(sensor_msgs::PointCloud2& msg, const uint16_t* depth, float depth_unit, int width, int height,
+                                        bool ordered, const PointCloudBuilder::ChunkFunction& build_chunk)
+{
+    const std::size_t point_count = _pointcloud_builder->build(_deprojector, depth, depth_unit, msg.point_step, ordered,
+                                                               build_chunk, msg.data);
+    // Organized clouds keep neighbouring pixels neighbours, with NaN points where there is no depth.
+    msg.width = ordered ? width : point_count;
+    msg.height = ordered ? height : 1;
+    msg.is_dense = !ordered;
+    msg.row_step = msg.width * msg.point_step;
+}
+
+void BaseRealSenseNode::publishPointsWithNormals(const rs2::depth_frame& depth_frame, const ros::Time& t)
+{
+    sensor_msgs::PointCloud2 msg;
+    msg.header.stamp = t;
+    msg.header.frame_id = _optical_frame_id[DEPTH];
+    msg.height = 1;
+    msg.is_dense = true;
+
+    // Normals are padded to 16 bytes like the position, as in the PointNormal type of PCL.
+    sensor_msgs::PointCloud2Modifier modifier(msg);
+    modifier.setPointCloud2FieldsByString(1, "xyz");
+    msg.point_step = addPointField(msg, "normal_x", 1, sensor_msgs::PointField::FLOAT32, msg.point_step);
+    msg.point_step = addPointField(msg, "normal_y", 1, sensor_msgs::PointField::FLOAT32, msg.point_step);
+    msg.point_step = addPointField(msg, "normal_z", 1, sensor_msgs::PointField::FLOAT32, msg.point_step);
+    msg.point_step = 8 * sizeof(float);
+
+    auto depth_profile = depth_frame.get_profile().as<rs2::video_stream_profile>();
+    _deprojector.setIntrinsics(depth_profile.get_intrinsics());
+    const uint16_t* depth = reinterpret_cast<const uint16_t*>(depth_frame.get_data());
+    const float depth_unit = depth_frame.get_units();
+    const int width = depth_profile.width();
+    const int height = depth_profile.height();
+    const std::size_t point_step = msg.point_step;
+
+    // As for the point cloud, but a point is only valid if it also has a normal.
+    auto build_chunk = [&](std::size_t begin, std::size_t count, const float* vertices, bool ordered, uint8_t* out)
+    {
+        float normals[3 * PointCloudBuilder::CHUNK_SIZE];
+        uint8_t masks[PointCloudBuilder::CHUNK_SIZE / 8];
+        depth_normals(depth, _deprojector.rayX(), _deprojector.rayY(), width, height, _pointcloud_normals_radius,
+                      depth_unit, NORMALS_MAX_DEPTH_CHANGE, begin, count, normals);
+        valid_point_masks(vertices, nullptr, count, false, masks);
+        if (_pointcloud_crop_enabled)
+            crop_point_masks(vertices, count, _pointcloud_crop, masks);
+
+        std::size_t points = 0;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const float* normal = normals + 3 * i;
+            const bool valid = ((masks[i / 8] >> (i % 8)) & 1) && !std::isnan(normal[0]);
+            points += valid;
+            if (!out || (!valid && !ordered))
+                continue;
+            const float nan = std::numeric_limits<float>::quiet_NaN();
+            const float record[8] = {valid ? vertices[3 * i] : nan, valid ? vertices[3 * i + 1] : nan,
+                                     valid ? vertices[3 * i + 2] : nan, 0.f,
+                                     valid ? normal[0] : nan, valid ? normal[1] : nan, valid ? normal[2] : nan, 0.f};
+            memcpy(out, record, sizeof(record));
+            out += point_step;
+        }
+        return points;
+    };
+
+    buildPointCloud(msg, depth, depth_unit, width, height, _ordered_pc, build_chunk);
+    _normals_publisher.publish(msg);
+}
+
+void BaseRealSenseNode::publishHeightMap(const rs2::depth_frame& depth_frame, const ros::Time& t)
+{
+    HeightMapPtr msg = boost::make_shared<HeightMap>();
+    msg->header.stamp = t;
+    msg->header.frame_id = _base_frame_id;
+    msg->resolution = _height_map->resolution();
+    msg->width = _height_map->width();
+    msg->height = _height_map->height();
+    msg->origin_x = _height_map->originX();
+    msg->origin_y = _height_map->originY();
+    msg->max_height.resize(msg->width * msg->height);
+
+    // Points go straight from the depth image to the cells, without a point cloud.
+    auto depth_profile = depth_frame.get_profile().as<rs2::video_stream_profile>();
+    _deprojector.setIntrinsics(depth_profile.get_intrinsics());
+    _height_map->build(_deprojector, reinterpret_cast<const uint16_t*>(depth_frame.get_data()), depth_frame.get_units(),
+                       _pointcloud_crop_enabled ? &_pointcloud_crop : nullptr, msg->max_height.data());
+    _height_map_publisher.publish(msg);
+}
+
 Extrinsics BaseRealSenseNode::rsExtrinsicsToMsg(const rs2_extrinsics& extrinsics, const std::string& frame_id) const
 {
     Extrinsics extrinsicsMsg;
@@ -2400,6 +3267,11 @@ void BaseRealSenseNode::publishFrame(rs2::frame f, const ros::Time& t,
                                      std::map<stream_index_pair, cv::Mat>& images,
                                      const std::map<stream_index_pair, ros::Publisher>& info_publishers,
                                      const std::map<stream_index_pair, ImagePublisherWithFrequencyDiagnostics>& image_publishers,
+                                     const std::map<stream_index_pair, ros::Publisher>& zero_copy_image_publishers,
+                                     const std::map<stream_index_pair, uint64_t>& image_subscribers,
+                                     const std::map<stream_index_pair, ImageRegion>& image_regions,
+                                     const std::map<stream_index_pair, std::vector<std::shared_ptr<DerivedImagePublisher>>>& derived_publishers,
+                                     const std::map<stream_index_pair, std::shared_ptr<ImageMessagePools>>& message_pools,
                                      std::map<stream_index_pair, int>& seq,
                                      std::map<stream_index_pair, sensor_msgs::CameraInfo>& camera_info,
                                      const std::map<stream_index_pair, std::string>& optical_frame_id,
@@ -2427,26 +3299,131 @@ void BaseRealSenseNode::publishFrame(rs2::frame f, const ros::Time& t,
         }
         image.data = (uint8_t*)f.get_data();
     }
-    if (f.is<rs2::depth_frame>())
-    {
-        image = fix_depth_scale(image, _depth_scaled_image[stream]);
-    }
+    // Depth clipping (unless already done in place) and unit conversion happen while copying into the message.
+    bool is_depth = f.is<rs2::depth_frame>() && bpp == sizeof(uint16_t);
+    bool clip_depth_data = is_depth && isDepthClipEnabled() && !_clip_depth_in_place;
+    bool rescale_depth_data = is_depth && fabs(_depth_scale_meters - ROS_DEPTH_SCALE) >= 1e-6;
+    bool convert_depth = clip_depth_data || rescale_depth_data;
+
+    // The region of interest is cropped and binned while copying into the message as well.
+    const std::string& image_encoding = encoding.at(stream.first);
+    auto requested_region = image_regions.find(stream);
+    bool crop_image = (requested_region != image_regions.end() && requested_region->second.isActive());
+    ImageRegion region;
+    if (crop_image)
+    {
+        region = requested_region->second.clamped(width, height);
+        bool can_bin = is_depth ||
+                       (sensor_msgs::image_encodings::bitDepth(image_encoding) == 8 &&
+                        !sensor_msgs::image_encodings::isBayer(image_encoding) &&
+                        !isPackedYuv422(image_encoding));
+        if (region.binning > 1 && !can_bin)
+        {
+            ROS_WARN_STREAM_ONCE("Binning is not supported for " << image_encoding << " images; publishing the region of interest unbinned.");
+            region = requested_region->second;
+            region.binning = 1;
+            region = region.clamped(width, height);
+        }
+    }
+    const unsigned int out_width = crop_image ? region.outputWidth() : width;
+    const unsigned int out_height = crop_image ? region.outputHeight() : height;
+    auto fill_image_data = [&](uint8_t* data, std::size_t size)
+    {
+        if (crop_image)
+            copyImageRegion(image.data, width, bpp, region, is_depth, clip_depth_data, rescale_depth_data, data);
+        else if (convert_depth)
+            process_depth(reinterpret_cast<const uint16_t*>(image.data), width, reinterpret_cast<uint16_t*>(data), width, height,
+                          clip_depth_data, rescale_depth_data);
+        else
+            memcpy(data, image.data, size);
+    };
 
     ++(seq[stream]);
     auto& info_publisher = info_publishers.at(stream);
     auto& image_publisher = image_publishers.at(stream);
-    if(0 != info_publisher.getNumSubscribers() ||
-       0 != image_publisher.first.getNumSubscribers())
-    {
-        sensor_msgs::ImagePtr img;
-        img = cv_bridge::CvImage(std_msgs::Header(), encoding.at(stream.first), image).toImageMsg();
-        img->width = width;
-        img->height = height;
-        img->is_bigendian = false;
-        img->step = width * bpp;
-        img->header.frame_id = optical_frame_id.at(stream);
-        img->header.stamp = t;
-        img->header.seq = seq[stream];
+    auto zero_copy_publisher = zero_copy_image_publishers.find(stream);
+    bool is_zero_copy = (zero_copy_publisher != zero_copy_image_publishers.end());
+    // The image subscribers include those of the derived topics, which only need the pixels.
+    uint64_t image_topics = image_subscribers.at(stream);
+    std::vector<DerivedImagePublisher*> active_derived_publishers;
+    bool derived_from_image = false;
+    auto derived_publishers_it = derived_publishers.find(stream);
+    if (derived_publishers_it != derived_publishers.end())
+    {
+        for (auto& derived_publisher : derived_publishers_it->second)
+        {
+            image_topics &= ~derived_publisher->subscribers;
+            if (derived_publisher->canPublish(image_encoding) && _subscribers.hasSubscribers(derived_publisher->subscribers))
+            {
+                active_derived_publishers.push_back(derived_publisher.get());
+                derived_from_image |= !(is_depth && derived_publisher->usesFrameDepth());
+            }
+        }
+    }
+    bool publish_image = _subscribers.hasSubscribers(image_topics);
+    if (publish_image || !active_derived_publishers.empty())
+    {
+        // Pixels of the published image, which the derived topics are produced from. Unless they
+        // have to be converted, they are read straight from the frame. Otherwise the message holding
+        // them is kept until the derived topics are done: once published, it may be its only owner.
+        const uint8_t* image_data = (convert_depth || crop_image) ? nullptr : image.data;
+        sensor_msgs::ImagePtr converted_image;
+        FrameImagePtr zero_copy_image;
+        if (!publish_image)
+        {
+            if (!image_data && derived_from_image)
+            {
+                converted_image = message_pools.at(stream)->image.acquire();
+                converted_image->data.resize(out_height * out_width * bpp);
+                fill_image_data(converted_image->data.data(), converted_image->data.size());
+                image_data = converted_image->data.data();
+            }
+        }
+        else if (is_zero_copy)
+        {
+            // Borrow the frame buffer unless its pixels have to be rewritten (e.g. depth rescaling or
+            // cropping), in which case the message owns the converted image.
+            FrameImagePtr& img = zero_copy_image;
+            if (image.data == f.get_data() && !convert_depth && !crop_image)
+                img = boost::make_shared<FrameImage>(FrameBufferAllocator<void>(f));
+            else
+                img = boost::make_shared<FrameImage>();
+            img->data.resize(out_height * out_width * bpp);
+            if (img->data.data() != f.get_data())
+            {
+                fill_image_data(img->data.data(), img->data.size());
+            }
+            img->encoding = image_encoding.c_str();
+            img->width = out_width;
+            img->height = out_height;
+            img->is_bigendian = false;
+            img->step = out_width * bpp;
+            img->header.frame_id = optical_frame_id.at(stream).c_str();
+            img->header.stamp = t;
+            img->header.seq = seq[stream];
+            zero_copy_publisher->second.publish(img);
+            if (!image_data)
+                image_data = img->data.data();
+        }
+        else
+        {
+            // Recycled messages keep their buffers, so refilling them does not allocate.
+            sensor_msgs::ImagePtr& img = converted_image;
+            img = message_pools.at(stream)->image.acquire();
+            img->encoding = image_encoding;
+            img->width = out_width;
+            img->height = out_height;
+            img->is_bigendian = false;
+            img->step = out_width * bpp;
+            img->data.resize(img->step * out_height);
+            fill_image_data(img->data.data(), img->data.size());
+            img->header.frame_id = optical_frame_id.at(stream);
+            img->header.stamp = t;
+            img->header.seq = seq[stream];
+            image_publisher.first.publish(img);
+            if (!image_data)
+                image_data = img->data.data();
+        }
 
         auto& cam_info = camera_info.at(stream);
         if (cam_info.width != width)
@@ -2455,9 +3432,60 @@ void BaseRealSenseNode::publishFrame(rs2::frame f, const ros::Time& t,
         }
         cam_info.header.stamp = t;
         cam_info.header.seq = seq[stream];
-        info_publisher.publish(cam_info);
+        sensor_msgs::CameraInfoPtr info = message_pools.at(stream)->camera_info.acquire();
+        *info = cam_info;
+        if (crop_image)
+        {
+            // The intrinsics stay those of the full image; roi and binning tell how the published image maps onto it.
+            info->roi.x_offset = region.x_offset;
+            info->roi.y_offset = region.y_offset;
+            info->roi.width = region.width;
+            info->roi.height = region.height;
+            info->binning_x = region.binning;
+            info->binning_y = region.binning;
+        }
+        info_publisher.publish(info);
+
+        if (!active_derived_publishers.empty())
+        {
+            std_msgs::Header header;
+            header.frame_id = optical_frame_id.at(stream);
+            header.stamp = t;
+            header.seq = seq[stream];
+            // Depth in the units of the camera, clipped, cropped and binned like the image but not
+            // rescaled. It is the published depth unless that had to be rescaled.
+            const uint16_t* frame_depth = nullptr;
+            sensor_msgs::ImagePtr frame_depth_image;
+            for (auto derived_publisher : active_derived_publishers)
+            {
+                if (!(is_depth && derived_publisher->usesFrameDepth()))
+                {
+                    derived_publisher->publish(image_data, out_width, out_height, out_width * bpp, image_encoding, header, *info);
+                    continue;
+                }
+                if (!frame_depth)
+                {
+                    if (!rescale_depth_data && image_data)
+                        frame_depth = reinterpret_cast<const uint16_t*>(image_data);
+                    else if (!clip_depth_data && !crop_image)
+                        frame_depth = reinterpret_cast<const uint16_t*>(image.data);
+                    else
+                    {
+                        frame_depth_image = message_pools.at(stream)->image.acquire();
+                        frame_depth_image->data.resize(out_height * out_width * bpp);
+                        uint8_t* data = frame_depth_image->data.data();
+                        if (crop_image)
+                            copyImageRegion(image.data, width, bpp, region, is_depth, clip_depth_data, false, data);
+                        else
+                            process_depth(reinterpret_cast<const uint16_t*>(image.data), width, reinterpret_cast<uint16_t*>(data),
+                                          width, height, clip_depth_data, false);
+                        frame_depth = reinterpret_cast<const uint16_t*>(data);
+                    }
+                }
+                derived_publisher->publishDepth(frame_depth, _depth_scale_meters, out_width, out_height, header, *info);
+            }
+        }
 
-        image_publisher.first.publish(img);
         image_publisher.second->update();
         // ROS_INFO_STREAM("fid: " << cam_info.header.seq << ", time: " << std::setprecision (20) << t.toSec());
         ROS_DEBUG("%s stream published", rs2_stream_to_string(f.get_profile().stream_type()));
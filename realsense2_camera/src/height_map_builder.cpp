@@ -0,0 +1,96 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/height_map_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace realsense2_camera
+{
+
+HeightMapBuilder::HeightMapBuilder(float resolution, const float area[4], int threads) :
+    _resolution(resolution),
+    _origin{area[0], area[1]},
+    _width(std::max(static_cast<int>(std::ceil((area[2] - area[0]) / resolution)), 1)),
+    _height(std::max(static_cast<int>(std::ceil((area[3] - area[1]) / resolution)), 1)),
+    _rotation{1, 0, 0, 0, 1, 0, 0, 0, 1},
+    _translation{0, 0, 0},
+    _pool(std::max(threads, 1)),
+    _grids(_pool.size())
+{
+}
+
+void HeightMapBuilder::setTransform(const float rotation[9], const float translation[3])
+{
+    std::copy(rotation, rotation + 9, _rotation);
+    std::copy(translation, translation + 3, _translation);
+}
+
+void HeightMapBuilder::build(const DepthDeprojector& deprojector, const uint16_t* depth, float depth_unit,
+                      const crop_volume* crop, float* max_heights)
+{
+    const int grid_count = static_cast<int>(_grids.size());
+    const std::size_t cell_count = static_cast<std::size_t>(_width) * _height;
+    const std::size_t point_count = deprojector.size();
+    _pool.run(grid_count, [&](int g)
+    {
+        _grids[g].assign(cell_count, -std::numeric_limits<float>::infinity());
+        rasterize(deprojector, depth, depth_unit, crop, point_count * g / grid_count, point_count * (g + 1) / grid_count,
+                  _grids[g].data());
+    });
+
+    // Merged over ranges of cells.
+    _pool.run(grid_count, [&](int range)
+    {
+        const std::size_t begin = cell_count * range / grid_count;
+        const std::size_t end = cell_count * (range + 1) / grid_count;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            float max_height = _grids[0][i];
+            for (int g = 1; g < grid_count; ++g)
+            {
+                max_height = std::max(max_height, _grids[g][i]);
+            }
+            max_heights[i] = std::isinf(max_height) ? std::numeric_limits<float>::quiet_NaN() : max_height;
+        }
+    });
+}
+
+void HeightMapBuilder::rasterize(const DepthDeprojector& deprojector, const uint16_t* depth, float depth_unit,
+                          const crop_volume* crop, std::size_t begin, std::size_t end, float* grid) const
+{
+    const std::size_t CHUNK_SIZE = 1024;
+    float vertices[3 * CHUNK_SIZE];
+    uint8_t masks[CHUNK_SIZE / 8];
+    const float inverse_resolution = 1.f / _resolution;
+    const float* r = _rotation;
+    for (std::size_t chunk = begin; chunk < end; chunk += CHUNK_SIZE)
+    {
+        const std::size_t count = std::min(CHUNK_SIZE, end - chunk);
+        deprojector.deproject(depth, chunk, count, depth_unit, vertices);
+        valid_point_masks(vertices, nullptr, count, false, masks);
+        if (crop)
+            crop_point_masks(vertices, count, *crop, masks);
+
+        for (std::size_t byte = 0; byte < (count + 7) / 8; ++byte)
+        {
+            for (unsigned int bits = masks[byte]; bits != 0; bits &= bits - 1)
+            {
+                const float* v = vertices + 3 * (byte * 8 + __builtin_ctz(bits));
+                const float x = r[0] * v[0] + r[1] * v[1] + r[2] * v[2] + _translation[0];
+                const float y = r[3] * v[0] + r[4] * v[1] + r[5] * v[2] + _translation[1];
+                const float z = r[6] * v[0] + r[7] * v[1] + r[8] * v[2] + _translation[2];
+                // Cell coordinates are compared as floats first, so that far points cannot overflow an int.
+                const float cell_x = std::floor((x - _origin[0]) * inverse_resolution);
+                const float cell_y = std::floor((y - _origin[1]) * inverse_resolution);
+                if (!(cell_x >= 0 && cell_x < _width && cell_y >= 0 && cell_y < _height))
+                    continue;
+                float& cell = grid[static_cast<std::size_t>(cell_y) * _width + static_cast<std::size_t>(cell_x)];
+                cell = std::max(cell, z);
+            }
+        }
+    }
+}
+
+}  // namespace realsense2_camera
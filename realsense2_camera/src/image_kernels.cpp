@@ -0,0 +1,898 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/image_kernels.h"
+#include "../include/kernel_isa.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace realsense2_camera
+{
+
+namespace
+{
+
+// Resolved once, when the library is loaded, unless overridden by set_image_kernels_isa().
+kernel_isa g_isa = detect_kernel_isa();
+
+// Reference implementations. The float to integer conversion goes through int32 and keeps the
+// low 16 bits, which is what the compiler emits for the former uint16_t cast on all our targets.
+inline uint16_t clip_value(uint16_t value, uint16_t min_value, uint16_t max_value)
+{
+    return (value < min_value || value > max_value) ? 0 : value;
+}
+
+void clip_depth_range_scalar(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        dst[i] = clip_value(src[i], min_value, max_value);
+    }
+}
+
+void clip_rescale_depth_scalar(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value,
+                               float from_scale, float to_scale)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        dst[i] = static_cast<uint16_t>(static_cast<int32_t>(clip_value(src[i], min_value, max_value) * from_scale / to_scale));
+    }
+}
+
+void depth_to_meters_scalar(const uint16_t* src, float* dst, std::size_t count, float scale)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        dst[i] = src[i] ? src[i] * scale : nan;
+    }
+}
+
+// Smallest non-zero value of a and b, 0 if both are 0: subtracting 1 turns 0 into the largest value.
+inline uint16_t min_nonzero(uint16_t a, uint16_t b)
+{
+    return static_cast<uint16_t>(std::min<uint16_t>(a - 1, b - 1) + 1);
+}
+
+void accumulate_row_scalar(const uint8_t* src, uint16_t* acc, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        acc[i] += src[i];
+    }
+}
+
+void min_nonzero_row_scalar(const uint16_t* src, uint16_t* acc, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        acc[i] = min_nonzero(acc[i], src[i]);
+    }
+}
+
+void min_depth_in_range_row_scalar(const uint16_t* src, const uint16_t* min_values, const uint16_t* max_values,
+                                   uint16_t* acc, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const bool in_range = (src[i] >= min_values[i] && src[i] <= max_values[i]);
+        acc[i] = min_nonzero(acc[i], in_range ? src[i] : 0);
+    }
+}
+
+// Packed 4:2:2 byte offsets of the first luma, the blue and the red difference sample of a pixel pair.
+struct yuv422_offsets
+{
+    explicit yuv422_offsets(bool uyvy) : y(uyvy ? 1 : 0), u(uyvy ? 0 : 1), v(uyvy ? 2 : 3) {}
+    int y, u, v;
+};
+
+inline uint8_t clamp_byte(int32_t value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// BT.601 limited range to RGB, in the integer form librealsense uses for its own RGB8 output.
+inline void yuv_to_rgb(int32_t y, int32_t u, int32_t v, uint8_t* dst, bool bgr)
+{
+    const int32_t c = y - 16, d = u - 128, e = v - 128;
+    const uint8_t r = clamp_byte((298 * c + 409 * e + 128) >> 8);
+    const uint8_t g = clamp_byte((298 * c - 100 * d - 208 * e + 128) >> 8);
+    const uint8_t b = clamp_byte((298 * c + 516 * d + 128) >> 8);
+    dst[0] = bgr ? b : r;
+    dst[1] = g;
+    dst[2] = bgr ? r : b;
+}
+
+void yuv422_to_rgb_scalar(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy, bool bgr)
+{
+    const yuv422_offsets offsets(uyvy);
+    for (std::size_t i = 0; i + 1 < pixel_count; i += 2, src += 4, dst += 6)
+    {
+        yuv_to_rgb(src[offsets.y], src[offsets.u], src[offsets.v], dst, bgr);
+        yuv_to_rgb(src[offsets.y + 2], src[offsets.u], src[offsets.v], dst + 3, bgr);
+    }
+}
+
+void yuv422_to_mono_scalar(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy)
+{
+    const int y = uyvy ? 1 : 0;
+    for (std::size_t i = 0; i < pixel_count; ++i)
+    {
+        dst[i] = src[2 * i + y];
+    }
+}
+
+#if defined(RS_KERNELS_X86)
+
+// A value lies inside [min, max] iff clamping leaves it unchanged; values outside become 0.
+__attribute__((target("sse4.1")))
+inline __m128i clip_sse41(__m128i in, __m128i min_value, __m128i max_value)
+{
+    __m128i clamped = _mm_min_epu16(_mm_max_epu16(in, min_value), max_value);
+    return _mm_and_si128(in, _mm_cmpeq_epi16(in, clamped));
+}
+
+__attribute__((target("avx2")))
+inline __m256i clip_avx2(__m256i in, __m256i min_value, __m256i max_value)
+{
+    __m256i clamped = _mm256_min_epu16(_mm256_max_epu16(in, min_value), max_value);
+    return _mm256_and_si256(in, _mm256_cmpeq_epi16(in, clamped));
+}
+
+__attribute__((target("sse4.1")))
+void clip_depth_range_sse41(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value)
+{
+    const __m128i min_v = _mm_set1_epi16(static_cast<short>(min_value));
+    const __m128i max_v = _mm_set1_epi16(static_cast<short>(max_value));
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), clip_sse41(in, min_v, max_v));
+    }
+    clip_depth_range_scalar(src + i, dst + i, count - i, min_value, max_value);
+}
+
+__attribute__((target("avx2")))
+void clip_depth_range_avx2(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value)
+{
+    const __m256i min_v = _mm256_set1_epi16(static_cast<short>(min_value));
+    const __m256i max_v = _mm256_set1_epi16(static_cast<short>(max_value));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), clip_avx2(in, min_v, max_v));
+    }
+    clip_depth_range_sse41(src + i, dst + i, count - i, min_value, max_value);
+}
+
+__attribute__((target("sse4.1")))
+void clip_rescale_depth_sse41(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value,
+                              float from_scale, float to_scale)
+{
+    const __m128i min_v = _mm_set1_epi16(static_cast<short>(min_value));
+    const __m128i max_v = _mm_set1_epi16(static_cast<short>(max_value));
+    const __m128 from = _mm_set1_ps(from_scale);
+    const __m128 to = _mm_set1_ps(to_scale);
+    const __m128i low_bits = _mm_set1_epi32(0xFFFF);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i in = clip_sse41(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), min_v, max_v);
+        __m128 lo = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(in));
+        __m128 hi = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_srli_si128(in, 8)));
+        // Multiply, then divide: the same two roundings as the scalar expression.
+        __m128i lo_i = _mm_and_si128(_mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(lo, from), to)), low_bits);
+        __m128i hi_i = _mm_and_si128(_mm_cvttps_epi32(_mm_div_ps(_mm_mul_ps(hi, from), to)), low_bits);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi32(lo_i, hi_i));
+    }
+    clip_rescale_depth_scalar(src + i, dst + i, count - i, min_value, max_value, from_scale, to_scale);
+}
+
+__attribute__((target("avx2")))
+void clip_rescale_depth_avx2(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value,
+                             float from_scale, float to_scale)
+{
+    const __m256i min_v = _mm256_set1_epi16(static_cast<short>(min_value));
+    const __m256i max_v = _mm256_set1_epi16(static_cast<short>(max_value));
+    const __m256 from = _mm256_set1_ps(from_scale);
+    const __m256 to = _mm256_set1_ps(to_scale);
+    const __m256i low_bits = _mm256_set1_epi32(0xFFFF);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i in = clip_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), min_v, max_v);
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(in)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(in, 1)));
+        __m256i lo_i = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_div_ps(_mm256_mul_ps(lo, from), to)), low_bits);
+        __m256i hi_i = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_div_ps(_mm256_mul_ps(hi, from), to)), low_bits);
+        // packus works per 128-bit lane; restore the element order afterwards.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo_i, hi_i), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+    clip_rescale_depth_sse41(src + i, dst + i, count - i, min_value, max_value, from_scale, to_scale);
+}
+
+__attribute__((target("sse4.1")))
+void depth_to_meters_sse41(const uint16_t* src, float* dst, std::size_t count, float scale)
+{
+    const __m128 scale_v = _mm_set1_ps(scale);
+    const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const __m128i zero = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_cvtepu16_epi32(in);
+        __m128i hi = _mm_cvtepu16_epi32(_mm_srli_si128(in, 8));
+        __m128 lo_m = _mm_mul_ps(_mm_cvtepi32_ps(lo), scale_v);
+        __m128 hi_m = _mm_mul_ps(_mm_cvtepi32_ps(hi), scale_v);
+        _mm_storeu_ps(dst + i, _mm_blendv_ps(lo_m, nan, _mm_castsi128_ps(_mm_cmpeq_epi32(lo, zero))));
+        _mm_storeu_ps(dst + i + 4, _mm_blendv_ps(hi_m, nan, _mm_castsi128_ps(_mm_cmpeq_epi32(hi, zero))));
+    }
+    depth_to_meters_scalar(src + i, dst + i, count - i, scale);
+}
+
+__attribute__((target("avx2")))
+void depth_to_meters_avx2(const uint16_t* src, float* dst, std::size_t count, float scale)
+{
+    const __m256 scale_v = _mm256_set1_ps(scale);
+    const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(in));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(in, 1));
+        __m256 lo_m = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale_v);
+        __m256 hi_m = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale_v);
+        _mm256_storeu_ps(dst + i, _mm256_blendv_ps(lo_m, nan, _mm256_castsi256_ps(_mm256_cmpeq_epi32(lo, zero))));
+        _mm256_storeu_ps(dst + i + 8, _mm256_blendv_ps(hi_m, nan, _mm256_castsi256_ps(_mm256_cmpeq_epi32(hi, zero))));
+    }
+    depth_to_meters_sse41(src + i, dst + i, count - i, scale);
+}
+
+__attribute__((target("sse4.1")))
+void accumulate_row_sse41(const uint8_t* src, uint16_t* acc, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i in = _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        __m128i sum = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), in);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), sum);
+    }
+    accumulate_row_scalar(src + i, acc + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void accumulate_row_avx2(const uint8_t* src, uint16_t* acc, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i in = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        __m256i sum = _mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i)), in);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), sum);
+    }
+    accumulate_row_sse41(src + i, acc + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void min_nonzero_row_sse41(const uint16_t* src, uint16_t* acc, std::size_t count)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i a = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), one);
+        __m128i b = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), one);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi16(_mm_min_epu16(a, b), one));
+    }
+    min_nonzero_row_scalar(src + i, acc + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void min_nonzero_row_avx2(const uint16_t* src, uint16_t* acc, std::size_t count)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i a = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i)), one);
+        __m256i b = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), one);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi16(_mm256_min_epu16(a, b), one));
+    }
+    min_nonzero_row_sse41(src + i, acc + i, count - i);
+}
+
+// There are no unsigned 16-bit comparisons before AVX-512: value is within [min, max] if clamping
+// it leaves it unchanged.
+__attribute__((target("sse4.1")))
+void min_depth_in_range_row_sse41(const uint16_t* src, const uint16_t* min_values, const uint16_t* max_values,
+                                  uint16_t* acc, std::size_t count)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i clamped = _mm_min_epu16(_mm_max_epu16(value, _mm_loadu_si128(reinterpret_cast<const __m128i*>(min_values + i))),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(max_values + i)));
+        value = _mm_and_si128(value, _mm_cmpeq_epi16(value, clamped));
+        __m128i a = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), one);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_add_epi16(_mm_min_epu16(a, _mm_sub_epi16(value, one)), one));
+    }
+    min_depth_in_range_row_scalar(src + i, min_values + i, max_values + i, acc + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void min_depth_in_range_row_avx2(const uint16_t* src, const uint16_t* min_values, const uint16_t* max_values,
+                                 uint16_t* acc, std::size_t count)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i clamped = _mm256_min_epu16(_mm256_max_epu16(value, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(min_values + i))),
+                                           _mm256_loadu_si256(reinterpret_cast<const __m256i*>(max_values + i)));
+        value = _mm256_and_si256(value, _mm256_cmpeq_epi16(value, clamped));
+        __m256i a = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i)), one);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_add_epi16(_mm256_min_epu16(a, _mm256_sub_epi16(value, one)), one));
+    }
+    min_depth_in_range_row_sse41(src + i, min_values + i, max_values + i, acc + i, count - i);
+}
+
+// (298 * c + kd * d + ke * e + 128) >> 8 on 32-bit lanes.
+__attribute__((target("sse4.1")))
+inline __m128i yuv_channel_sse41(__m128i c298, __m128i d, __m128i e, int32_t kd, int32_t ke)
+{
+    __m128i sum = _mm_add_epi32(c298, _mm_set1_epi32(128));
+    if (kd)
+        sum = _mm_add_epi32(sum, _mm_mullo_epi32(d, _mm_set1_epi32(kd)));
+    if (ke)
+        sum = _mm_add_epi32(sum, _mm_mullo_epi32(e, _mm_set1_epi32(ke)));
+    return _mm_srai_epi32(sum, 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256i yuv_channel_avx2(__m256i c298, __m256i d, __m256i e, int32_t kd, int32_t ke)
+{
+    __m256i sum = _mm256_add_epi32(c298, _mm256_set1_epi32(128));
+    if (kd)
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(d, _mm256_set1_epi32(kd)));
+    if (ke)
+        sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(e, _mm256_set1_epi32(ke)));
+    return _mm256_srai_epi32(sum, 8);
+}
+
+// Saturates 8 pixels of 16-bit channels to bytes (the clamp of the scalar code) and stores them
+// interleaved: 24 bytes, first, second and third channel of every pixel.
+__attribute__((target("sse4.1")))
+inline void store_interleaved_sse41(__m128i first, __m128i second, __m128i third, uint8_t* dst)
+{
+    const char X = -128;
+    const __m128i pair = _mm_packus_epi16(first, second);
+    const __m128i last = _mm_packus_epi16(third, third);
+    const __m128i out0 = _mm_or_si128(_mm_shuffle_epi8(pair, _mm_setr_epi8(0, 8, X, 1, 9, X, 2, 10, X, 3, 11, X, 4, 12, X, 5)),
+                                      _mm_shuffle_epi8(last, _mm_setr_epi8(X, X, 0, X, X, 1, X, X, 2, X, X, 3, X, X, 4, X)));
+    const __m128i out1 = _mm_or_si128(_mm_shuffle_epi8(pair, _mm_setr_epi8(13, X, 6, 14, X, 7, 15, X, X, X, X, X, X, X, X, X)),
+                                      _mm_shuffle_epi8(last, _mm_setr_epi8(X, 5, X, X, 6, X, X, 7, X, X, X, X, X, X, X, X)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), out0);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 16), out1);
+}
+
+// Shuffle moving the bytes at the given offsets of 4 consecutive pixels into 32-bit lanes.
+__attribute__((target("sse4.1")))
+inline __m128i lanes_mask(int p0, int p1, int p2, int p3)
+{
+    const char X = -128;
+    return _mm_setr_epi8(p0, X, X, X, p1, X, X, X, p2, X, X, X, p3, X, X, X);
+}
+
+__attribute__((target("sse4.1")))
+void yuv422_to_rgb_sse41(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy, bool bgr)
+{
+    const yuv422_offsets o(uyvy);
+    const __m128i y_lo = lanes_mask(o.y, o.y + 2, o.y + 4, o.y + 6), y_hi = lanes_mask(o.y + 8, o.y + 10, o.y + 12, o.y + 14);
+    const __m128i u_lo = lanes_mask(o.u, o.u, o.u + 4, o.u + 4), u_hi = lanes_mask(o.u + 8, o.u + 8, o.u + 12, o.u + 12);
+    const __m128i v_lo = lanes_mask(o.v, o.v, o.v + 4, o.v + 4), v_hi = lanes_mask(o.v + 8, o.v + 8, o.v + 12, o.v + 12);
+    const __m128i y_bias = _mm_set1_epi32(16), uv_bias = _mm_set1_epi32(128), k298 = _mm_set1_epi32(298);
+    std::size_t i = 0;
+    for (; i + 8 <= pixel_count; i += 8, src += 16, dst += 24)
+    {
+        const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i channels[2][3];
+        for (int half = 0; half < 2; ++half)
+        {
+            __m128i c = _mm_sub_epi32(_mm_shuffle_epi8(in, half ? y_hi : y_lo), y_bias);
+            __m128i d = _mm_sub_epi32(_mm_shuffle_epi8(in, half ? u_hi : u_lo), uv_bias);
+            __m128i e = _mm_sub_epi32(_mm_shuffle_epi8(in, half ? v_hi : v_lo), uv_bias);
+            __m128i c298 = _mm_mullo_epi32(c, k298);
+            channels[half][0] = yuv_channel_sse41(c298, d, e, 0, 409);
+            channels[half][1] = yuv_channel_sse41(c298, d, e, -100, -208);
+            channels[half][2] = yuv_channel_sse41(c298, d, e, 516, 0);
+        }
+        const __m128i r = _mm_packs_epi32(channels[0][0], channels[1][0]);
+        const __m128i g = _mm_packs_epi32(channels[0][1], channels[1][1]);
+        const __m128i b = _mm_packs_epi32(channels[0][2], channels[1][2]);
+        store_interleaved_sse41(bgr ? b : r, g, bgr ? r : b, dst);
+    }
+    yuv422_to_rgb_scalar(src, dst, pixel_count - i, uyvy, bgr);
+}
+
+__attribute__((target("avx2")))
+void yuv422_to_rgb_avx2(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy, bool bgr)
+{
+    const yuv422_offsets o(uyvy);
+    // Both 128-bit lanes hold the same 8 pixels; the low lane extracts pixels 0-3, the high lane 4-7.
+    const __m256i y_mask = _mm256_setr_m128i(lanes_mask(o.y, o.y + 2, o.y + 4, o.y + 6), lanes_mask(o.y + 8, o.y + 10, o.y + 12, o.y + 14));
+    const __m256i u_mask = _mm256_setr_m128i(lanes_mask(o.u, o.u, o.u + 4, o.u + 4), lanes_mask(o.u + 8, o.u + 8, o.u + 12, o.u + 12));
+    const __m256i v_mask = _mm256_setr_m128i(lanes_mask(o.v, o.v, o.v + 4, o.v + 4), lanes_mask(o.v + 8, o.v + 8, o.v + 12, o.v + 12));
+    const __m256i y_bias = _mm256_set1_epi32(16), uv_bias = _mm256_set1_epi32(128), k298 = _mm256_set1_epi32(298);
+    std::size_t i = 0;
+    for (; i + 8 <= pixel_count; i += 8, src += 16, dst += 24)
+    {
+        const __m256i in = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+        __m256i c = _mm256_sub_epi32(_mm256_shuffle_epi8(in, y_mask), y_bias);
+        __m256i d = _mm256_sub_epi32(_mm256_shuffle_epi8(in, u_mask), uv_bias);
+        __m256i e = _mm256_sub_epi32(_mm256_shuffle_epi8(in, v_mask), uv_bias);
+        __m256i c298 = _mm256_mullo_epi32(c, k298);
+        __m256i r = yuv_channel_avx2(c298, d, e, 0, 409);
+        __m256i g = yuv_channel_avx2(c298, d, e, -100, -208);
+        __m256i b = yuv_channel_avx2(c298, d, e, 516, 0);
+        r = _mm256_packs_epi32(r, _mm256_permute2x128_si256(r, r, 0x01));
+        g = _mm256_packs_epi32(g, _mm256_permute2x128_si256(g, g, 0x01));
+        b = _mm256_packs_epi32(b, _mm256_permute2x128_si256(b, b, 0x01));
+        store_interleaved_sse41(_mm256_castsi256_si128(bgr ? b : r), _mm256_castsi256_si128(g),
+                                _mm256_castsi256_si128(bgr ? r : b), dst);
+    }
+    yuv422_to_rgb_scalar(src, dst, pixel_count - i, uyvy, bgr);
+}
+
+__attribute__((target("sse4.1")))
+void yuv422_to_mono_sse41(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy)
+{
+    const __m128i low_bytes = _mm_set1_epi16(0xFF);
+    std::size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16));
+        a = uyvy ? _mm_srli_epi16(a, 8) : _mm_and_si128(a, low_bytes);
+        b = uyvy ? _mm_srli_epi16(b, 8) : _mm_and_si128(b, low_bytes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(a, b));
+    }
+    yuv422_to_mono_scalar(src + 2 * i, dst + i, pixel_count - i, uyvy);
+}
+
+__attribute__((target("avx2")))
+void yuv422_to_mono_avx2(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy)
+{
+    const __m256i low_bytes = _mm256_set1_epi16(0xFF);
+    std::size_t i = 0;
+    for (; i + 32 <= pixel_count; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i + 32));
+        a = uyvy ? _mm256_srli_epi16(a, 8) : _mm256_and_si256(a, low_bytes);
+        b = uyvy ? _mm256_srli_epi16(b, 8) : _mm256_and_si256(b, low_bytes);
+        // packus works per 128-bit lane; restore the pixel order afterwards.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+    yuv422_to_mono_sse41(src + 2 * i, dst + i, pixel_count - i, uyvy);
+}
+
+#endif
+
+#if defined(RS_KERNELS_NEON)
+
+inline uint16x8_t clip_neon(uint16x8_t in, uint16x8_t min_value, uint16x8_t max_value)
+{
+    return vandq_u16(in, vandq_u16(vcgeq_u16(in, min_value), vcleq_u16(in, max_value)));
+}
+
+void clip_depth_range_neon(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value)
+{
+    const uint16x8_t min_v = vdupq_n_u16(min_value);
+    const uint16x8_t max_v = vdupq_n_u16(max_value);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        vst1q_u16(dst + i, clip_neon(vld1q_u16(src + i), min_v, max_v));
+    }
+    clip_depth_range_scalar(src + i, dst + i, count - i, min_value, max_value);
+}
+
+void clip_rescale_depth_neon(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value,
+                             float from_scale, float to_scale)
+{
+    const uint16x8_t min_v = vdupq_n_u16(min_value);
+    const uint16x8_t max_v = vdupq_n_u16(max_value);
+    const float32x4_t from = vdupq_n_f32(from_scale);
+    const float32x4_t to = vdupq_n_f32(to_scale);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t in = clip_neon(vld1q_u16(src + i), min_v, max_v);
+        float32x4_t lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(in)));
+        float32x4_t hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(in)));
+        int32x4_t lo_i = vcvtq_s32_f32(vdivq_f32(vmulq_f32(lo, from), to));
+        int32x4_t hi_i = vcvtq_s32_f32(vdivq_f32(vmulq_f32(hi, from), to));
+        // vmovn keeps the low 16 bits, like the scalar conversion.
+        vst1q_u16(dst + i, vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(lo_i)), vmovn_u32(vreinterpretq_u32_s32(hi_i))));
+    }
+    clip_rescale_depth_scalar(src + i, dst + i, count - i, min_value, max_value, from_scale, to_scale);
+}
+
+void depth_to_meters_neon(const uint16_t* src, float* dst, std::size_t count, float scale)
+{
+    const float32x4_t nan = vdupq_n_f32(std::numeric_limits<float>::quiet_NaN());
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t in = vld1q_u16(src + i);
+        uint32x4_t lo = vmovl_u16(vget_low_u16(in));
+        uint32x4_t hi = vmovl_u16(vget_high_u16(in));
+        float32x4_t lo_m = vmulq_n_f32(vcvtq_f32_u32(lo), scale);
+        float32x4_t hi_m = vmulq_n_f32(vcvtq_f32_u32(hi), scale);
+        vst1q_f32(dst + i, vbslq_f32(vceqq_u32(lo, vdupq_n_u32(0)), nan, lo_m));
+        vst1q_f32(dst + i + 4, vbslq_f32(vceqq_u32(hi, vdupq_n_u32(0)), nan, hi_m));
+    }
+    depth_to_meters_scalar(src + i, dst + i, count - i, scale);
+}
+
+void accumulate_row_neon(const uint8_t* src, uint16_t* acc, std::size_t count)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vld1_u8(src + i)));
+    }
+    accumulate_row_scalar(src + i, acc + i, count - i);
+}
+
+void min_nonzero_row_neon(const uint16_t* src, uint16_t* acc, std::size_t count)
+{
+    const uint16x8_t one = vdupq_n_u16(1);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t a = vsubq_u16(vld1q_u16(acc + i), one);
+        uint16x8_t b = vsubq_u16(vld1q_u16(src + i), one);
+        vst1q_u16(acc + i, vaddq_u16(vminq_u16(a, b), one));
+    }
+    min_nonzero_row_scalar(src + i, acc + i, count - i);
+}
+
+void min_depth_in_range_row_neon(const uint16_t* src, const uint16_t* min_values, const uint16_t* max_values,
+                                 uint16_t* acc, std::size_t count)
+{
+    const uint16x8_t one = vdupq_n_u16(1);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint16x8_t value = vld1q_u16(src + i);
+        uint16x8_t in_range = vandq_u16(vcgeq_u16(value, vld1q_u16(min_values + i)), vcleq_u16(value, vld1q_u16(max_values + i)));
+        uint16x8_t a = vsubq_u16(vld1q_u16(acc + i), one);
+        uint16x8_t b = vsubq_u16(vandq_u16(value, in_range), one);
+        vst1q_u16(acc + i, vaddq_u16(vminq_u16(a, b), one));
+    }
+    min_depth_in_range_row_scalar(src + i, min_values + i, max_values + i, acc + i, count - i);
+}
+
+// (298 * c + kd * d + ke * e + 128) >> 8, saturated to bytes.
+inline uint8x8_t yuv_channel_neon(int16x8_t c, int16x8_t d, int16x8_t e, int16_t kd, int16_t ke)
+{
+    int32x4_t lo = vmlal_n_s16(vdupq_n_s32(128), vget_low_s16(c), 298);
+    int32x4_t hi = vmlal_n_s16(vdupq_n_s32(128), vget_high_s16(c), 298);
+    lo = vmlal_n_s16(vmlal_n_s16(lo, vget_low_s16(d), kd), vget_low_s16(e), ke);
+    hi = vmlal_n_s16(vmlal_n_s16(hi, vget_high_s16(d), kd), vget_high_s16(e), ke);
+    return vqmovun_s16(vcombine_s16(vshrn_n_s32(lo, 8), vshrn_n_s32(hi, 8)));
+}
+
+void yuv422_to_rgb_neon(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy, bool bgr)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16, src += 32, dst += 48)
+    {
+        // 8 pixel pairs: first luma, blue difference, second luma, red difference.
+        const uint8x8x4_t in = vld4_u8(src);
+        const uint8x8_t y0 = uyvy ? in.val[1] : in.val[0];
+        const uint8x8_t y1 = uyvy ? in.val[3] : in.val[2];
+        const int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(uyvy ? in.val[0] : in.val[1], vdup_n_u8(128)));
+        const int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(uyvy ? in.val[2] : in.val[3], vdup_n_u8(128)));
+        const int16x8_t c0 = vreinterpretq_s16_u16(vsubl_u8(y0, vdup_n_u8(16)));
+        const int16x8_t c1 = vreinterpretq_s16_u16(vsubl_u8(y1, vdup_n_u8(16)));
+
+        // Even and odd pixels share their chroma; zip them back into pixel order.
+        const uint8x8x2_t r = vzip_u8(yuv_channel_neon(c0, d, e, 0, 409), yuv_channel_neon(c1, d, e, 0, 409));
+        const uint8x8x2_t g = vzip_u8(yuv_channel_neon(c0, d, e, -100, -208), yuv_channel_neon(c1, d, e, -100, -208));
+        const uint8x8x2_t b = vzip_u8(yuv_channel_neon(c0, d, e, 516, 0), yuv_channel_neon(c1, d, e, 516, 0));
+        uint8x16x3_t out;
+        out.val[0] = vcombine_u8((bgr ? b : r).val[0], (bgr ? b : r).val[1]);
+        out.val[1] = vcombine_u8(g.val[0], g.val[1]);
+        out.val[2] = vcombine_u8((bgr ? r : b).val[0], (bgr ? r : b).val[1]);
+        vst3q_u8(dst, out);
+    }
+    yuv422_to_rgb_scalar(src, dst, pixel_count - i, uyvy, bgr);
+}
+
+void yuv422_to_mono_neon(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= pixel_count; i += 16)
+    {
+        const uint8x16x2_t in = vld2q_u8(src + 2 * i);
+        vst1q_u8(dst + i, uyvy ? in.val[1] : in.val[0]);
+    }
+    yuv422_to_mono_scalar(src + 2 * i, dst + i, pixel_count - i, uyvy);
+}
+
+#endif
+
+}  // namespace
+
+const char* image_kernels_isa()
+{
+    switch (g_isa)
+    {
+        case kernel_isa::avx2: return "AVX2";
+        case kernel_isa::sse41: return "SSE4.1";
+        case kernel_isa::neon: return "NEON";
+        default: return "scalar";
+    }
+}
+
+bool set_image_kernels_isa(kernel_isa isa)
+{
+    if (!kernel_isa_supported(isa))
+        return false;
+    g_isa = isa;
+    return true;
+}
+
+void clip_depth_range(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            clip_depth_range_avx2(src, dst, count, min_value, max_value);
+            return;
+        case kernel_isa::sse41:
+            clip_depth_range_sse41(src, dst, count, min_value, max_value);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            clip_depth_range_neon(src, dst, count, min_value, max_value);
+            return;
+#endif
+        default:
+            clip_depth_range_scalar(src, dst, count, min_value, max_value);
+    }
+}
+
+void clip_rescale_depth(const uint16_t* src, uint16_t* dst, std::size_t count, uint16_t min_value, uint16_t max_value,
+                        float from_scale, float to_scale)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            clip_rescale_depth_avx2(src, dst, count, min_value, max_value, from_scale, to_scale);
+            return;
+        case kernel_isa::sse41:
+            clip_rescale_depth_sse41(src, dst, count, min_value, max_value, from_scale, to_scale);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            clip_rescale_depth_neon(src, dst, count, min_value, max_value, from_scale, to_scale);
+            return;
+#endif
+        default:
+            clip_rescale_depth_scalar(src, dst, count, min_value, max_value, from_scale, to_scale);
+    }
+}
+
+void depth_to_meters(const uint16_t* src, float* dst, std::size_t count, float scale)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            depth_to_meters_avx2(src, dst, count, scale);
+            return;
+        case kernel_isa::sse41:
+            depth_to_meters_sse41(src, dst, count, scale);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            depth_to_meters_neon(src, dst, count, scale);
+            return;
+#endif
+        default:
+            depth_to_meters_scalar(src, dst, count, scale);
+    }
+}
+
+void accumulate_row(const uint8_t* src, uint16_t* acc, std::size_t count)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            accumulate_row_avx2(src, acc, count);
+            return;
+        case kernel_isa::sse41:
+            accumulate_row_sse41(src, acc, count);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            accumulate_row_neon(src, acc, count);
+            return;
+#endif
+        default:
+            accumulate_row_scalar(src, acc, count);
+    }
+}
+
+void min_nonzero_row(const uint16_t* src, uint16_t* acc, std::size_t count)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            min_nonzero_row_avx2(src, acc, count);
+            return;
+        case kernel_isa::sse41:
+            min_nonzero_row_sse41(src, acc, count);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            min_nonzero_row_neon(src, acc, count);
+            return;
+#endif
+        default:
+            min_nonzero_row_scalar(src, acc, count);
+    }
+}
+
+void min_depth_in_range_row(const uint16_t* src, const uint16_t* min_values, const uint16_t* max_values,
+                            uint16_t* acc, std::size_t count)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            min_depth_in_range_row_avx2(src, min_values, max_values, acc, count);
+            return;
+        case kernel_isa::sse41:
+            min_depth_in_range_row_sse41(src, min_values, max_values, acc, count);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            min_depth_in_range_row_neon(src, min_values, max_values, acc, count);
+            return;
+#endif
+        default:
+            min_depth_in_range_row_scalar(src, min_values, max_values, acc, count);
+    }
+}
+
+void bin_row(const uint8_t* src, std::size_t src_stride, int factor, int out_width, int channels, uint16_t* scratch, uint8_t* dst)
+{
+    const std::size_t row_size = static_cast<std::size_t>(out_width) * factor * channels;
+    std::fill(scratch, scratch + row_size, 0);
+    for (int y = 0; y < factor; ++y)
+    {
+        accumulate_row(src + y * src_stride, scratch, row_size);
+    }
+    const int block_size = factor * factor;
+    for (int x = 0; x < out_width; ++x)
+    {
+        const uint16_t* block = scratch + static_cast<std::size_t>(x) * factor * channels;
+        for (int c = 0; c < channels; ++c)
+        {
+            int sum = 0;
+            for (int i = 0; i < factor; ++i)
+            {
+                sum += block[i * channels + c];
+            }
+            dst[x * channels + c] = static_cast<uint8_t>((sum + block_size / 2) / block_size);
+        }
+    }
+}
+
+void bin_depth_row(const uint16_t* src, std::size_t src_stride, int factor, int out_width,
+                   uint16_t min_value, uint16_t max_value, uint16_t* scratch, uint16_t* dst)
+{
+    const std::size_t row_size = static_cast<std::size_t>(out_width) * factor;
+    uint16_t* acc = scratch;
+    uint16_t* clipped = scratch + row_size;
+    std::fill(acc, acc + row_size, 0);
+    for (int y = 0; y < factor; ++y)
+    {
+        clip_depth_range(src + y * src_stride, clipped, row_size, min_value, max_value);
+        min_nonzero_row(clipped, acc, row_size);
+    }
+    for (int x = 0; x < out_width; ++x)
+    {
+        const uint16_t* block = acc + static_cast<std::size_t>(x) * factor;
+        uint16_t value = block[0];
+        for (int i = 1; i < factor; ++i)
+        {
+            value = min_nonzero(value, block[i]);
+        }
+        dst[x] = value;
+    }
+}
+
+void rescale_depth(const uint16_t* src, uint16_t* dst, std::size_t count, float from_scale, float to_scale)
+{
+    clip_rescale_depth(src, dst, count, 0, std::numeric_limits<uint16_t>::max(), from_scale, to_scale);
+}
+
+void yuv422_to_rgb(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy, bool bgr)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            yuv422_to_rgb_avx2(src, dst, pixel_count, uyvy, bgr);
+            return;
+        case kernel_isa::sse41:
+            yuv422_to_rgb_sse41(src, dst, pixel_count, uyvy, bgr);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            yuv422_to_rgb_neon(src, dst, pixel_count, uyvy, bgr);
+            return;
+#endif
+        default:
+            yuv422_to_rgb_scalar(src, dst, pixel_count, uyvy, bgr);
+    }
+}
+
+void yuv422_to_mono(const uint8_t* src, uint8_t* dst, std::size_t pixel_count, bool uyvy)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            yuv422_to_mono_avx2(src, dst, pixel_count, uyvy);
+            return;
+        case kernel_isa::sse41:
+            yuv422_to_mono_sse41(src, dst, pixel_count, uyvy);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            yuv422_to_mono_neon(src, dst, pixel_count, uyvy);
+            return;
+#endif
+        default:
+            yuv422_to_mono_scalar(src, dst, pixel_count, uyvy);
+    }
+}
+
+void yuv422_pixel_to_rgb(const uint8_t* row, std::size_t x, bool uyvy, uint8_t* rgb)
+{
+    const yuv422_offsets offsets(uyvy);
+    const uint8_t* pair = row + (x & ~static_cast<std::size_t>(1)) * 2;
+    yuv_to_rgb(pair[offsets.y + (x & 1) * 2], pair[offsets.u], pair[offsets.v], rgb, false);
+}
+
+}  // namespace realsense2_camera
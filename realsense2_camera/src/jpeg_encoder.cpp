@@ -0,0 +1,336 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/jpeg_encoder.h"
+#include "../include/derived_image_publisher.h"
+#include "../include/image_kernels.h"
+
+#include <ros/ros.h>
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+
+#include <jpeglib.h>
+
+namespace realsense2_camera
+{
+
+namespace
+{
+
+const uint8_t MARKER = 0xFF;
+const uint8_t SOF0 = 0xC0;
+const uint8_t RST0 = 0xD0;
+const uint8_t EOI = 0xD9;
+const uint8_t SOS = 0xDA;
+const uint8_t DRI = 0xDD;
+const std::size_t DRI_SIZE = 6;
+
+// Input of libjpeg for an image encoding. Packed YUV is converted to RGB before it is handed over.
+bool colorSpace(const std::string& encoding, J_COLOR_SPACE& color_space, int& components)
+{
+    if (isPackedYuv422(encoding))
+    {
+        color_space = JCS_EXT_RGB;
+        components = 3;
+    }
+    else if (encoding == "mono8")
+    {
+        color_space = JCS_GRAYSCALE;
+        components = 1;
+    }
+    else if (encoding == "rgb8")
+    {
+        color_space = JCS_EXT_RGB;
+        components = 3;
+    }
+    else if (encoding == "bgr8")
+    {
+        color_space = JCS_EXT_BGR;
+        components = 3;
+    }
+    else if (encoding == "rgba8")
+    {
+        color_space = JCS_EXT_RGBA;
+        components = 4;
+    }
+    else if (encoding == "bgra8")
+    {
+        color_space = JCS_EXT_BGRA;
+        components = 4;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Offsets of the frame header and of the scan header in an encoded image, and where the
+// entropy coded data following the scan header starts.
+struct ImageLayout
+{
+    std::size_t sof = 0;
+    std::size_t sos = 0;
+    std::size_t entropy = 0;
+};
+
+bool findLayout(const std::vector<uint8_t>& image, std::size_t size, ImageLayout& layout)
+{
+    bool has_sof = false;
+    std::size_t pos = 2; // After SOI
+    while (pos + 4 <= size && image[pos] == MARKER)
+    {
+        const uint8_t marker = image[pos + 1];
+        const std::size_t length = (image[pos + 2] << 8) | image[pos + 3];
+        if (marker == SOF0)
+        {
+            layout.sof = pos;
+            has_sof = true;
+        }
+        else if (marker == SOS)
+        {
+            layout.sos = pos;
+            layout.entropy = pos + 2 + length;
+            // The entropy coded data is followed by EOI.
+            return has_sof && layout.entropy + 2 <= size && image[size - 2] == MARKER && image[size - 1] == EOI;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+}  // namespace
+
+struct JpegEncoder::Stripe
+{
+    Stripe()
+    {
+        cinfo.err = jpeg_std_error(&error);
+        error.error_exit = &Stripe::onError;
+        jpeg_create_compress(&cinfo);
+        cinfo.client_data = this;
+
+        destination.init_destination = &Stripe::initDestination;
+        destination.empty_output_buffer = &Stripe::emptyOutputBuffer;
+        destination.term_destination = &Stripe::termDestination;
+        cinfo.dest = &destination;
+    }
+
+    ~Stripe()
+    {
+        jpeg_destroy_compress(&cinfo);
+    }
+
+    bool encode(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                J_COLOR_SPACE color_space, int components, int quality)
+    {
+        if (setjmp(jump))
+        {
+            jpeg_abort_compress(&cinfo);
+            return false;
+        }
+        cinfo.image_width = width;
+        cinfo.image_height = height;
+        cinfo.input_components = components;
+        cinfo.in_color_space = color_space;
+        jpeg_set_defaults(&cinfo);
+        jpeg_set_quality(&cinfo, quality, TRUE);
+
+        jpeg_start_compress(&cinfo, TRUE);
+        if (isPackedYuv422(encoding))
+        {
+            // Convert a few rows at a time, so that they are still in cache when libjpeg reads them.
+            const bool uyvy = (encoding == YUV422_UYVY);
+            const int batch = std::min(height, 16);
+            const std::size_t rgb_step = static_cast<std::size_t>(width) * 3;
+            converted.resize(rgb_step * batch);
+            rows.resize(batch);
+            while (cinfo.next_scanline < cinfo.image_height)
+            {
+                const int first = cinfo.next_scanline;
+                const int count = std::min(batch, height - first);
+                for (int y = 0; y < count; ++y)
+                {
+                    rows[y] = converted.data() + y * rgb_step;
+                    yuv422_to_rgb(data + static_cast<std::size_t>(first + y) * step, rows[y], width, uyvy, false);
+                }
+                int written = 0;
+                while (written < count)
+                {
+                    written += jpeg_write_scanlines(&cinfo, rows.data() + written, count - written);
+                }
+            }
+        }
+        else
+        {
+            // The scanlines are read straight from the caller's buffer.
+            rows.resize(height);
+            for (int y = 0; y < height; ++y)
+            {
+                rows[y] = const_cast<JSAMPROW>(data + static_cast<std::size_t>(y) * step);
+            }
+            while (cinfo.next_scanline < cinfo.image_height)
+            {
+                jpeg_write_scanlines(&cinfo, rows.data() + cinfo.next_scanline, cinfo.image_height - cinfo.next_scanline);
+            }
+        }
+        jpeg_finish_compress(&cinfo);
+        return true;
+    }
+
+    static void onError(j_common_ptr cinfo)
+    {
+        Stripe* stripe = static_cast<Stripe*>(cinfo->client_data);
+        (*cinfo->err->format_message)(cinfo, stripe->message);
+        longjmp(stripe->jump, 1);
+    }
+
+    // The output buffer is kept between frames and only grows.
+    static void initDestination(j_compress_ptr cinfo)
+    {
+        Stripe* stripe = static_cast<Stripe*>(cinfo->client_data);
+        if (stripe->buffer.size() < 65536)
+            stripe->buffer.resize(65536);
+        cinfo->dest->next_output_byte = stripe->buffer.data();
+        cinfo->dest->free_in_buffer = stripe->buffer.size();
+    }
+
+    static boolean emptyOutputBuffer(j_compress_ptr cinfo)
+    {
+        Stripe* stripe = static_cast<Stripe*>(cinfo->client_data);
+        const std::size_t size = stripe->buffer.size();
+        stripe->buffer.resize(size * 2);
+        cinfo->dest->next_output_byte = stripe->buffer.data() + size;
+        cinfo->dest->free_in_buffer = size;
+        return TRUE;
+    }
+
+    static void termDestination(j_compress_ptr cinfo)
+    {
+        Stripe* stripe = static_cast<Stripe*>(cinfo->client_data);
+        stripe->size = stripe->buffer.size() - cinfo->dest->free_in_buffer;
+    }
+
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr error;
+    jpeg_destination_mgr destination;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+    std::vector<JSAMPROW> rows;
+    std::vector<uint8_t> converted;
+    std::vector<uint8_t> buffer;
+    std::size_t size = 0;
+    bool encoded = false;
+};
+
+JpegEncoder::JpegEncoder(int quality, int threads) :
+    _quality(std::min(std::max(quality, 1), 100)),
+    _pool(std::max(threads, 1))
+{
+    for (int i = 0; i < _pool.size(); ++i)
+    {
+        _stripes.emplace_back(new Stripe());
+    }
+}
+
+JpegEncoder::~JpegEncoder() = default;
+
+bool JpegEncoder::canEncode(const std::string& encoding)
+{
+    J_COLOR_SPACE color_space;
+    int components;
+    return colorSpace(encoding, color_space, components);
+}
+
+bool JpegEncoder::encode(const uint8_t* data, int width, int height, int step, const std::string& encoding,
+                         std::vector<uint8_t>& out)
+{
+    J_COLOR_SPACE color_space;
+    int components;
+    if (!colorSpace(encoding, color_space, components) || width <= 0 || height <= 0)
+        return false;
+
+    // Default sampling: 4:2:0 for color, so an MCU covers 16x16 pixels, and 8x8 for grayscale.
+    // Stripes are made of whole MCU rows, so that each one is a whole restart interval.
+    const int mcu_size = (components == 1) ? 8 : 16;
+    const int mcu_columns = (width + mcu_size - 1) / mcu_size;
+    const int mcu_rows = (height + mcu_size - 1) / mcu_size;
+    const int stripe_mcu_rows = (mcu_rows + _pool.size() - 1) / _pool.size();
+    const int stripe_height = stripe_mcu_rows * mcu_size;
+    int stripe_count = (height + stripe_height - 1) / stripe_height;
+    const int restart_interval = stripe_mcu_rows * mcu_columns;
+    // DRI holds a 16-bit interval.
+    if (restart_interval > 0xFFFF)
+        stripe_count = 1;
+
+    _pool.run(stripe_count, [&](int i)
+    {
+        const int first_row = i * stripe_height;
+        const int rows = (stripe_count == 1) ? height : std::min(stripe_height, height - first_row);
+        Stripe& stripe = *_stripes[i];
+        stripe.encoded = stripe.encode(data + static_cast<std::size_t>(first_row) * step, width, rows, step, encoding,
+                                       color_space, components, _quality);
+    });
+
+    std::vector<ImageLayout> layouts(stripe_count);
+    for (int i = 0; i < stripe_count; ++i)
+    {
+        Stripe& stripe = *_stripes[i];
+        if (!stripe.encoded)
+        {
+            ROS_WARN_STREAM_THROTTLE(5, "JPEG encoding failed: " << stripe.message);
+            return false;
+        }
+        if (!findLayout(stripe.buffer, stripe.size, layouts[i]))
+        {
+            ROS_WARN_THROTTLE(5, "JPEG encoding failed: unexpected libjpeg output.");
+            return false;
+        }
+    }
+
+    const Stripe& first = *_stripes[0];
+    if (stripe_count == 1)
+    {
+        out.assign(first.buffer.begin(), first.buffer.begin() + first.size);
+        return true;
+    }
+
+    // Headers of the first stripe, a restart interval, then the entropy coded data of all
+    // stripes separated by restart markers.
+    std::size_t total_size = layouts[0].sos + DRI_SIZE + (layouts[0].entropy - layouts[0].sos) + 2;
+    for (int i = 0; i < stripe_count; ++i)
+    {
+        total_size += (_stripes[i]->size - 2 - layouts[i].entropy) + (i > 0 ? 2 : 0);
+    }
+    out.resize(total_size);
+
+    uint8_t* p = out.data();
+    memcpy(p, first.buffer.data(), layouts[0].sos);
+    p[layouts[0].sof + 5] = static_cast<uint8_t>(height >> 8);
+    p[layouts[0].sof + 6] = static_cast<uint8_t>(height);
+    p += layouts[0].sos;
+    const uint8_t dri[DRI_SIZE] = {MARKER, DRI, 0, 4, static_cast<uint8_t>(restart_interval >> 8), static_cast<uint8_t>(restart_interval)};
+    memcpy(p, dri, DRI_SIZE);
+    p += DRI_SIZE;
+    memcpy(p, first.buffer.data() + layouts[0].sos, layouts[0].entropy - layouts[0].sos);
+    p += layouts[0].entropy - layouts[0].sos;
+    for (int i = 0; i < stripe_count; ++i)
+    {
+        if (i > 0)
+        {
+            *p++ = MARKER;
+            *p++ = static_cast<uint8_t>(RST0 + (i - 1) % 8);
+        }
+        const Stripe& stripe = *_stripes[i];
+        const std::size_t entropy_size = stripe.size - 2 - layouts[i].entropy;
+        memcpy(p, stripe.buffer.data() + layouts[i].entropy, entropy_size);
+        p += entropy_size;
+    }
+    *p++ = MARKER;
+    *p++ = EOI;
+    return true;
+}
+
+}  // namespace realsense2_camera
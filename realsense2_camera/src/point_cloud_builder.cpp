@@ -0,0 +1,73 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/point_cloud_builder.h"
+
+#include <algorithm>
+
+namespace realsense2_camera
+{
+
+const std::size_t PointCloudBuilder::CHUNK_SIZE;
+
+PointCloudBuilder::PointCloudBuilder(int threads) :
+    _pool(std::max(threads, 1))
+{
+}
+
+std::size_t PointCloudBuilder::build(const DepthDeprojector& deprojector, const uint16_t* depth, float depth_unit,
+                                     std::size_t point_step, bool ordered, const ChunkFunction& chunk_function,
+                                     std::vector<uint8_t>& data)
+{
+    const std::size_t point_count = deprojector.size();
+    // A few tiles per thread balance the load, as the number of points varies across the image.
+    const int tile_count = static_cast<int>(std::max<std::size_t>(1, std::min<std::size_t>(4 * _pool.size(),
+                                                                                          point_count / CHUNK_SIZE)));
+    auto tile_begin = [&](int tile) { return point_count * tile / tile_count; };
+
+    // Runs the chunks of a tile, writing from out unless it is null, and returns the number of points.
+    auto run_tile = [&](int tile, uint8_t* out)
+    {
+        float vertices[3 * CHUNK_SIZE];
+        std::size_t tile_points = 0;
+        const std::size_t end = tile_begin(tile + 1);
+        for (std::size_t chunk = tile_begin(tile); chunk < end; chunk += CHUNK_SIZE)
+        {
+            const std::size_t count = std::min(CHUNK_SIZE, end - chunk);
+            deprojector.deproject(depth, chunk, count, depth_unit, vertices);
+            const std::size_t chunk_points = chunk_function(chunk, count, vertices, ordered, out);
+            tile_points += chunk_points;
+            if (out)
+                out += (ordered ? count : chunk_points) * point_step;
+        }
+        return tile_points;
+    };
+
+    if (ordered)
+    {
+        data.resize(point_count * point_step);
+        _pool.run(tile_count, [&](int tile)
+        {
+            run_tile(tile, data.data() + tile_begin(tile) * point_step);
+        });
+        return point_count;
+    }
+
+    _tile_offsets.resize(tile_count + 1);
+    _pool.run(tile_count, [&](int tile)
+    {
+        _tile_offsets[tile + 1] = run_tile(tile, nullptr);
+    });
+    _tile_offsets[0] = 0;
+    for (int tile = 0; tile < tile_count; ++tile)
+    {
+        _tile_offsets[tile + 1] += _tile_offsets[tile];
+    }
+    data.resize(_tile_offsets[tile_count] * point_step);
+    _pool.run(tile_count, [&](int tile)
+    {
+        run_tile(tile, data.data() + _tile_offsets[tile] * point_step);
+    });
+    return _tile_offsets[tile_count];
+}
+
+}  // namespace realsense2_camera
@@ -0,0 +1,802 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/point_cloud_kernels.h"
+#include "../include/image_kernels.h"
+#include "../include/kernel_isa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace realsense2_camera
+{
+
+namespace
+{
+
+// Resolved once, when the library is loaded, unless overridden by set_point_cloud_kernels_isa().
+kernel_isa g_isa = detect_kernel_isa();
+
+inline bool in_unit_range(float value)
+{
+    return value >= 0.f && value <= 1.f;
+}
+
+void deproject_depth_scalar(const uint16_t* depth, const float* ray_x, const float* ray_y, std::size_t count, float depth_unit, float* vertices)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const float z = depth[i] * depth_unit;
+        vertices[3 * i] = ray_x[i] * z;
+        vertices[3 * i + 1] = ray_y[i] * z;
+        vertices[3 * i + 2] = z;
+    }
+}
+
+void depth_normals_scalar(const uint16_t* depth, const float* ray_x, const float* ray_y, int width, int height, int radius,
+                          float depth_unit, float max_depth_change, std::size_t begin, std::size_t count, float* normals)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const std::ptrdiff_t dx = radius;
+    const std::ptrdiff_t dy = static_cast<std::ptrdiff_t>(radius) * width;
+    const float change = max_depth_change * radius;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        float* n = normals + 3 * i;
+        n[0] = n[1] = n[2] = nan;
+        const std::size_t p = begin + i;
+        const int u = static_cast<int>(p % width);
+        const int v = static_cast<int>(p / width);
+        if (u < radius || u >= width - radius || v < radius || v >= height - radius)
+            continue;
+        const float zc = depth[p] * depth_unit;
+        const float zl = depth[p - dx] * depth_unit;
+        const float zr = depth[p + dx] * depth_unit;
+        const float zu = depth[p - dy] * depth_unit;
+        const float zd = depth[p + dy] * depth_unit;
+        const float tolerance = change * zc;
+        if (!(zc > 0.f && zl > 0.f && zr > 0.f && zu > 0.f && zd > 0.f) ||
+            std::fabs(zl - zc) > tolerance || std::fabs(zr - zc) > tolerance ||
+            std::fabs(zu - zc) > tolerance || std::fabs(zd - zc) > tolerance)
+            continue;
+        const float hx = zr * ray_x[p + dx] - zl * ray_x[p - dx];
+        const float hy = zr * ray_y[p + dx] - zl * ray_y[p - dx];
+        const float hz = zr - zl;
+        const float vx = zd * ray_x[p + dy] - zu * ray_x[p - dy];
+        const float vy = zd * ray_y[p + dy] - zu * ray_y[p - dy];
+        const float vz = zd - zu;
+        // Vertical cross horizontal faces the camera, as image rows go down.
+        float nx = vy * hz - vz * hy;
+        float ny = vz * hx - vx * hz;
+        float nz = vx * hy - vy * hx;
+        const float length2 = nx * nx + ny * ny + nz * nz;
+        if (!(length2 > 0.f))
+            continue;
+        float scale = 1.f / std::sqrt(length2);
+        if (nx * ray_x[p] + ny * ray_y[p] + nz > 0.f)
+            scale = -scale;
+        n[0] = nx * scale;
+        n[1] = ny * scale;
+        n[2] = nz * scale;
+    }
+}
+
+void valid_point_masks_scalar(const float* vertices, const float* texcoords, std::size_t count, bool check_texture, uint8_t* masks)
+{
+    memset(masks, 0, (count + 7) / 8);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        bool valid = vertices[3 * i + 2] > 0.f &&
+                     (!check_texture || (in_unit_range(texcoords[2 * i]) && in_unit_range(texcoords[2 * i + 1])));
+        if (valid)
+            masks[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+    }
+}
+
+void crop_point_masks_scalar(const float* vertices, std::size_t count, const crop_volume& crop, uint8_t* masks)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const float* p = vertices + 3 * i;
+        bool inside = p[2] >= crop.z_min && p[2] <= crop.z_max &&
+                      std::fabs(p[0]) <= crop.x_slope_max * p[2] && std::fabs(p[1]) <= crop.y_slope_max * p[2];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float* r = crop.rotation + 3 * axis;
+            const float b = (r[0] * p[0] + r[1] * p[1]) + (r[2] * p[2] + crop.translation[axis]);
+            inside = inside && b >= crop.box_min[axis] && b <= crop.box_max[axis];
+        }
+        if (!inside)
+            masks[i / 8] &= static_cast<uint8_t>(~(1 << (i % 8)));
+    }
+}
+
+void texture_colors_scalar(const float* texcoords, std::size_t count, const uint8_t* texture, int width, int height,
+                           texture_format format, uint32_t* colors)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const float u = texcoords[2 * i];
+        const float v = texcoords[2 * i + 1];
+        if (!in_unit_range(u) || !in_unit_range(v))
+        {
+            colors[i] = 0;
+            continue;
+        }
+        const int x = std::min(static_cast<int>(u * width), width - 1);
+        const int y = std::min(static_cast<int>(v * height), height - 1);
+        const std::size_t pixel = static_cast<std::size_t>(y) * width + x;
+        switch (format)
+        {
+            case texture_format::mono8:
+                colors[i] = texture[pixel];
+                break;
+            case texture_format::rgb8:
+            {
+                const uint8_t* rgb = texture + 3 * pixel;
+                colors[i] = rgb[2] | (rgb[1] << 8) | (rgb[0] << 16);
+                break;
+            }
+            default:
+            {
+                uint8_t rgb[3];
+                yuv422_pixel_to_rgb(texture + static_cast<std::size_t>(y) * width * 2, x, format == texture_format::uyvy, rgb);
+                colors[i] = rgb[2] | (rgb[1] << 8) | (rgb[0] << 16);
+            }
+        }
+    }
+}
+
+void write_point_records_scalar(const float* vertices, const uint8_t* masks, std::size_t count, uint8_t* out, std::size_t point_step)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    for (std::size_t i = 0; i < count; ++i, out += point_step)
+    {
+        const bool valid = masks[i / 8] & (1 << (i % 8));
+        const float record[4] = {valid ? vertices[3 * i] : nan, valid ? vertices[3 * i + 1] : nan, valid ? vertices[3 * i + 2] : nan, 0.f};
+        memcpy(out, record, sizeof(record));
+    }
+}
+
+// Bit 3k + 2 of the comparison bits of 8 consecutive x, y, z vertices is the one of z of point k.
+inline uint8_t z_bits(uint32_t xyz_bits)
+{
+    uint32_t bits = 0;
+    for (int k = 0; k < 8; ++k)
+    {
+        bits |= ((xyz_bits >> (3 * k + 2)) & 1) << k;
+    }
+    return static_cast<uint8_t>(bits);
+}
+
+// Bits 2k and 2k + 1 of the comparison bits of 8 consecutive u, v pairs are those of point k;
+// keeps the points for which both are set.
+inline uint8_t uv_bits(uint32_t uv_bits)
+{
+    uint32_t bits = uv_bits & (uv_bits >> 1) & 0x5555;
+    bits = (bits | (bits >> 1)) & 0x3333;
+    bits = (bits | (bits >> 2)) & 0x0F0F;
+    bits = (bits | (bits >> 4)) & 0x00FF;
+    return static_cast<uint8_t>(bits);
+}
+
+#if defined(RS_KERNELS_X86)
+
+// Interleaves the x, y, z of 4 points into 3 vectors: x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3. The
+// 256-bit variant does the same in each 128-bit lane.
+__attribute__((target("sse4.1")))
+inline void interleave_xyz_sse41(__m128 x, __m128 y, __m128 z, __m128 out[3])
+{
+    const __m128 xy_low = _mm_unpacklo_ps(x, y);
+    const __m128 xy_high = _mm_unpackhi_ps(x, y);
+    out[0] = _mm_shuffle_ps(xy_low, _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    out[1] = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), xy_high, _MM_SHUFFLE(1, 0, 2, 0));
+    out[2] = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+__attribute__((target("avx2")))
+inline void interleave_xyz_avx2(__m256 x, __m256 y, __m256 z, __m256 out[3])
+{
+    const __m256 xy_low = _mm256_unpacklo_ps(x, y);
+    const __m256 xy_high = _mm256_unpackhi_ps(x, y);
+    out[0] = _mm256_shuffle_ps(xy_low, _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    out[1] = _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), xy_high, _MM_SHUFFLE(1, 0, 2, 0));
+    out[2] = _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+// Inverse of interleave_xyz_sse41().
+__attribute__((target("sse4.1")))
+inline void deinterleave_xyz_sse41(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+{
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+__attribute__((target("avx2")))
+inline void deinterleave_xyz_avx2(__m256 a, __m256 b, __m256 c, __m256& x, __m256& y, __m256& z)
+{
+    x = _mm256_shuffle_ps(a, _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+__attribute__((target("sse4.1")))
+void deproject_depth_sse41(const uint16_t* depth, const float* ray_x, const float* ray_y, std::size_t count, float depth_unit, float* vertices)
+{
+    const __m128 unit = _mm_set1_ps(depth_unit);
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i d = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + i)));
+        const __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(d), unit);
+        __m128 out[3];
+        interleave_xyz_sse41(_mm_mul_ps(_mm_loadu_ps(ray_x + i), z), _mm_mul_ps(_mm_loadu_ps(ray_y + i), z), z, out);
+        for (int v = 0; v < 3; ++v)
+        {
+            _mm_storeu_ps(vertices + 3 * i + 4 * v, out[v]);
+        }
+    }
+    deproject_depth_scalar(depth + i, ray_x + i, ray_y + i, count - i, depth_unit, vertices + 3 * i);
+}
+
+__attribute__((target("avx2")))
+void deproject_depth_avx2(const uint16_t* depth, const float* ray_x, const float* ray_y, std::size_t count, float depth_unit, float* vertices)
+{
+    const __m256 unit = _mm256_set1_ps(depth_unit);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i d = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i)));
+        const __m256 z = _mm256_mul_ps(_mm256_cvtepi32_ps(d), unit);
+        __m256 out[3];
+        interleave_xyz_avx2(_mm256_mul_ps(_mm256_loadu_ps(ray_x + i), z), _mm256_mul_ps(_mm256_loadu_ps(ray_y + i), z), z, out);
+        // The low lanes hold points i..i+3, the high lanes points i+4..i+7.
+        for (int v = 0; v < 3; ++v)
+        {
+            _mm_storeu_ps(vertices + 3 * i + 4 * v, _mm256_castps256_ps128(out[v]));
+            _mm_storeu_ps(vertices + 3 * i + 12 + 4 * v, _mm256_extractf128_ps(out[v], 1));
+        }
+    }
+    deproject_depth_scalar(depth + i, ray_x + i, ray_y + i, count - i, depth_unit, vertices + 3 * i);
+}
+
+__attribute__((target("sse4.1")))
+void crop_point_masks_sse41(const float* vertices, std::size_t count, const crop_volume& crop, uint8_t* masks)
+{
+    const __m128 sign = _mm_set1_ps(-0.f);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint32_t inside_bits = 0;
+        for (int half = 0; half < 2; ++half)
+        {
+            const float* p = vertices + 3 * (i + 4 * half);
+            __m128 x, y, z;
+            deinterleave_xyz_sse41(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x, y, z);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(z, _mm_set1_ps(crop.z_min)), _mm_cmple_ps(z, _mm_set1_ps(crop.z_max)));
+            inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_andnot_ps(sign, x), _mm_mul_ps(_mm_set1_ps(crop.x_slope_max), z)));
+            inside = _mm_and_ps(inside, _mm_cmple_ps(_mm_andnot_ps(sign, y), _mm_mul_ps(_mm_set1_ps(crop.y_slope_max), z)));
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const float* r = crop.rotation + 3 * axis;
+                __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[0]), x), _mm_mul_ps(_mm_set1_ps(r[1]), y)),
+                                      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(r[2]), z), _mm_set1_ps(crop.translation[axis])));
+                inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(b, _mm_set1_ps(crop.box_min[axis])), _mm_cmple_ps(b, _mm_set1_ps(crop.box_max[axis]))));
+            }
+            inside_bits |= static_cast<uint32_t>(_mm_movemask_ps(inside)) << (4 * half);
+        }
+        masks[i / 8] &= static_cast<uint8_t>(inside_bits);
+    }
+    crop_point_masks_scalar(vertices + 3 * i, count - i, crop, masks + i / 8);
+}
+
+__attribute__((target("avx2")))
+void crop_point_masks_avx2(const float* vertices, std::size_t count, const crop_volume& crop, uint8_t* masks)
+{
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // The low lanes get points i..i+3, the high lanes points i+4..i+7.
+        const float* p = vertices + 3 * i;
+        __m256 x, y, z;
+        deinterleave_xyz_avx2(_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1),
+                              _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1),
+                              _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1), x, y, z);
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(z, _mm256_set1_ps(crop.z_min), _CMP_GE_OQ), _mm256_cmp_ps(z, _mm256_set1_ps(crop.z_max), _CMP_LE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_andnot_ps(sign, x), _mm256_mul_ps(_mm256_set1_ps(crop.x_slope_max), z), _CMP_LE_OQ));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_andnot_ps(sign, y), _mm256_mul_ps(_mm256_set1_ps(crop.y_slope_max), z), _CMP_LE_OQ));
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float* r = crop.rotation + 3 * axis;
+            __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[0]), x), _mm256_mul_ps(_mm256_set1_ps(r[1]), y)),
+                                     _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(r[2]), z), _mm256_set1_ps(crop.translation[axis])));
+            inside = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(b, _mm256_set1_ps(crop.box_min[axis]), _CMP_GE_OQ),
+                                                         _mm256_cmp_ps(b, _mm256_set1_ps(crop.box_max[axis]), _CMP_LE_OQ)));
+        }
+        masks[i / 8] &= static_cast<uint8_t>(_mm256_movemask_ps(inside));
+    }
+    crop_point_masks_scalar(vertices + 3 * i, count - i, crop, masks + i / 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256 load_depth_avx2(const uint16_t* depth, __m256 unit)
+{
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(depth)))), unit);
+}
+
+// Lanes where depth z is valid and within tolerance of zc.
+__attribute__((target("avx2")))
+inline __m256 depth_within_avx2(__m256 z, __m256 zc, __m256 tolerance)
+{
+    const __m256 magnitude = _mm256_andnot_ps(_mm256_set1_ps(-0.f), _mm256_sub_ps(z, zc));
+    return _mm256_and_ps(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_cmp_ps(magnitude, tolerance, _CMP_LE_OQ));
+}
+
+// 8 pixels of a row at a time, those near the border of the image being left to the scalar code.
+__attribute__((target("avx2")))
+void depth_normals_avx2(const uint16_t* depth, const float* ray_x, const float* ray_y, int width, int height, int radius,
+                        float depth_unit, float max_depth_change, std::size_t begin, std::size_t count, float* normals)
+{
+    const std::ptrdiff_t dx = radius;
+    const std::ptrdiff_t dy = static_cast<std::ptrdiff_t>(radius) * width;
+    const __m256 unit = _mm256_set1_ps(depth_unit);
+    const __m256 change = _mm256_set1_ps(max_depth_change * radius);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256 nan = _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+
+    std::size_t i = 0;
+    while (i < count)
+    {
+        const std::size_t p = begin + i;
+        const int u = static_cast<int>(p % width);
+        const int v = static_cast<int>(p / width);
+        const std::size_t row_end = std::min(count, i + (width - u));
+        if (v < radius || v >= height - radius)
+        {
+            depth_normals_scalar(depth, ray_x, ray_y, width, height, radius, depth_unit, max_depth_change, p, row_end - i, normals + 3 * i);
+            i = row_end;
+            continue;
+        }
+        if (u < radius)
+        {
+            const std::size_t border = std::min<std::size_t>(row_end - i, radius - u);
+            depth_normals_scalar(depth, ray_x, ray_y, width, height, radius, depth_unit, max_depth_change, p, border, normals + 3 * i);
+            i += border;
+            continue;
+        }
+        const std::size_t interior_end = std::min(row_end, i + std::max(0, width - radius - u));
+        for (; i + 8 <= interior_end; i += 8)
+        {
+            const std::size_t q = begin + i;
+            const __m256 zc = load_depth_avx2(depth + q, unit);
+            const __m256 zl = load_depth_avx2(depth + q - dx, unit);
+            const __m256 zr = load_depth_avx2(depth + q + dx, unit);
+            const __m256 zu = load_depth_avx2(depth + q - dy, unit);
+            const __m256 zd = load_depth_avx2(depth + q + dy, unit);
+            const __m256 tolerance = _mm256_mul_ps(change, zc);
+            __m256 valid = _mm256_and_ps(_mm256_cmp_ps(zc, zero, _CMP_GT_OQ), _mm256_and_ps(depth_within_avx2(zl, zc, tolerance), depth_within_avx2(zr, zc, tolerance)));
+            valid = _mm256_and_ps(valid, _mm256_and_ps(depth_within_avx2(zu, zc, tolerance), depth_within_avx2(zd, zc, tolerance)));
+            const __m256 hx = _mm256_sub_ps(_mm256_mul_ps(zr, _mm256_loadu_ps(ray_x + q + dx)), _mm256_mul_ps(zl, _mm256_loadu_ps(ray_x + q - dx)));
+            const __m256 hy = _mm256_sub_ps(_mm256_mul_ps(zr, _mm256_loadu_ps(ray_y + q + dx)), _mm256_mul_ps(zl, _mm256_loadu_ps(ray_y + q - dx)));
+            const __m256 hz = _mm256_sub_ps(zr, zl);
+            const __m256 vx = _mm256_sub_ps(_mm256_mul_ps(zd, _mm256_loadu_ps(ray_x + q + dy)), _mm256_mul_ps(zu, _mm256_loadu_ps(ray_x + q - dy)));
+            const __m256 vy = _mm256_sub_ps(_mm256_mul_ps(zd, _mm256_loadu_ps(ray_y + q + dy)), _mm256_mul_ps(zu, _mm256_loadu_ps(ray_y + q - dy)));
+            const __m256 vz = _mm256_sub_ps(zd, zu);
+            const __m256 nx = _mm256_sub_ps(_mm256_mul_ps(vy, hz), _mm256_mul_ps(vz, hy));
+            const __m256 ny = _mm256_sub_ps(_mm256_mul_ps(vz, hx), _mm256_mul_ps(vx, hz));
+            const __m256 nz = _mm256_sub_ps(_mm256_mul_ps(vx, hy), _mm256_mul_ps(vy, hx));
+            const __m256 length2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+            valid = _mm256_and_ps(valid, _mm256_cmp_ps(length2, zero, _CMP_GT_OQ));
+            __m256 scale = _mm256_div_ps(one, _mm256_sqrt_ps(length2));
+            const __m256 facing = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(ray_x + q)), _mm256_mul_ps(ny, _mm256_loadu_ps(ray_y + q))), nz);
+            scale = _mm256_xor_ps(scale, _mm256_and_ps(sign, _mm256_cmp_ps(facing, zero, _CMP_GT_OQ)));
+            __m256 out[3];
+            interleave_xyz_avx2(_mm256_blendv_ps(nan, _mm256_mul_ps(nx, scale), valid), _mm256_blendv_ps(nan, _mm256_mul_ps(ny, scale), valid),
+                                _mm256_blendv_ps(nan, _mm256_mul_ps(nz, scale), valid), out);
+            float* n = normals + 3 * i;
+            for (int k = 0; k < 3; ++k)
+            {
+                _mm_storeu_ps(n + 4 * k, _mm256_castps256_ps128(out[k]));
+                _mm_storeu_ps(n + 12 + 4 * k, _mm256_extractf128_ps(out[k], 1));
+            }
+        }
+        depth_normals_scalar(depth, ray_x, ray_y, width, height, radius, depth_unit, max_depth_change, begin + i, row_end - i, normals + 3 * i);
+        i = row_end;
+    }
+}
+
+__attribute__((target("sse4.1")))
+inline uint32_t positive_bits_sse41(const float* values, int vectors)
+{
+    const __m128 zero = _mm_setzero_ps();
+    uint32_t bits = 0;
+    for (int v = 0; v < vectors; ++v)
+    {
+        bits |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(values + 4 * v), zero))) << (4 * v);
+    }
+    return bits;
+}
+
+__attribute__((target("sse4.1")))
+inline uint32_t unit_range_bits_sse41(const float* values, int vectors)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    uint32_t bits = 0;
+    for (int v = 0; v < vectors; ++v)
+    {
+        __m128 in = _mm_loadu_ps(values + 4 * v);
+        __m128 mask = _mm_and_ps(_mm_cmpge_ps(in, zero), _mm_cmple_ps(in, one));
+        bits |= static_cast<uint32_t>(_mm_movemask_ps(mask)) << (4 * v);
+    }
+    return bits;
+}
+
+__attribute__((target("sse4.1")))
+void valid_point_masks_sse41(const float* vertices, const float* texcoords, std::size_t count, bool check_texture, uint8_t* masks)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint8_t mask = z_bits(positive_bits_sse41(vertices + 3 * i, 6));
+        if (check_texture)
+            mask &= uv_bits(unit_range_bits_sse41(texcoords + 2 * i, 4));
+        masks[i / 8] = mask;
+    }
+    valid_point_masks_scalar(vertices + 3 * i, texcoords + 2 * i, count - i, check_texture, masks + i / 8);
+}
+
+// A record is written with one 16-byte store. Loading it reads the x of the next point, so the
+// last point is left to the scalar code.
+__attribute__((target("sse4.1")))
+void write_point_records_sse41(const float* vertices, const uint8_t* masks, std::size_t count, uint8_t* out, std::size_t point_step)
+{
+    const __m128 nan = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+    const __m128 zero = _mm_setzero_ps();
+    std::size_t i = 0;
+    for (; i + 1 < count; ++i, out += point_step)
+    {
+        const bool valid = masks[i / 8] & (1 << (i % 8));
+        __m128 record = valid ? _mm_loadu_ps(vertices + 3 * i) : nan;
+        _mm_storeu_ps(reinterpret_cast<float*>(out), _mm_blend_ps(record, zero, 0x8));
+    }
+    if (i < count)
+    {
+        // The mask of the last point is looked up relative to its own byte.
+        uint8_t last_mask = static_cast<uint8_t>(masks[i / 8] >> (i % 8));
+        write_point_records_scalar(vertices + 3 * i, &last_mask, 1, out, point_step);
+    }
+}
+
+// Gathers 4 bytes per pixel for 8 points at a time, then moves the channels into place. The
+// gather of a pixel less than 4 bytes from the end of the texture would read past it, so such
+// points are left to the scalar code, like the YUV formats.
+__attribute__((target("avx2")))
+void texture_colors_avx2(const float* texcoords, std::size_t count, const uint8_t* texture, int width, int height,
+                         texture_format format, uint32_t* colors)
+{
+    if (format != texture_format::rgb8 && format != texture_format::mono8)
+    {
+        texture_colors_scalar(texcoords, count, texture, width, height, format, colors);
+        return;
+    }
+    const int pixel_size = (format == texture_format::rgb8) ? 3 : 1;
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 size_x = _mm256_set1_ps(static_cast<float>(width));
+    const __m256 size_y = _mm256_set1_ps(static_cast<float>(height));
+    const __m256i max_x = _mm256_set1_epi32(width - 1);
+    const __m256i max_y = _mm256_set1_epi32(height - 1);
+    const __m256i row_size = _mm256_set1_epi32(width * pixel_size);
+    const __m256i last_safe = _mm256_set1_epi32(width * height * pixel_size - 4);
+    // r g b x -> b g r 0 for rgb8, y x x x -> y 0 0 0 for mono8.
+    const __m256i channels = (format == texture_format::rgb8) ?
+        _mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+                         2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1) :
+        _mm256_setr_epi8(0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1,
+                         0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // Deinterleave u and v: the shuffles give points 0 1 4 5 | 2 3 6 7, put back in order.
+        const __m256 uv_low = _mm256_loadu_ps(texcoords + 2 * i);
+        const __m256 uv_high = _mm256_loadu_ps(texcoords + 2 * i + 8);
+        const __m256 u = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(uv_low, uv_high, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+        const __m256 v = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(uv_low, uv_high, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+        const __m256 in_range = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)),
+                                              _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, one, _CMP_LE_OQ)));
+        // Out of range lanes may hold anything, their offset is replaced by 0.
+        const __m256i x = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(u, size_x)), max_x);
+        const __m256i y = _mm256_min_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(v, size_y)), max_y);
+        __m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(y, row_size), _mm256_mullo_epi32(x, _mm256_set1_epi32(pixel_size)));
+        const __m256i in_range_bits = _mm256_castps_si256(in_range);
+        offset = _mm256_and_si256(offset, in_range_bits);
+        const __m256i safe = _mm256_andnot_si256(_mm256_cmpgt_epi32(offset, last_safe), in_range_bits);
+        __m256i color = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int*>(texture), offset, safe, 1);
+        color = _mm256_and_si256(_mm256_shuffle_epi8(color, channels), safe);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i), color);
+        const int unsafe = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(safe, in_range_bits)));
+        for (int bits = unsafe; bits != 0; bits &= bits - 1)
+        {
+            const int k = __builtin_ctz(bits);
+            texture_colors_scalar(texcoords + 2 * (i + k), 1, texture, width, height, format, colors + i + k);
+        }
+    }
+    texture_colors_scalar(texcoords + 2 * i, count - i, texture, width, height, format, colors + i);
+}
+
+__attribute__((target("avx2")))
+void valid_point_masks_avx2(const float* vertices, const float* texcoords, std::size_t count, bool check_texture, uint8_t* masks)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const float* xyz = vertices + 3 * i;
+        uint32_t xyz_bits = 0;
+        for (int v = 0; v < 3; ++v)
+        {
+            xyz_bits |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(xyz + 8 * v), zero, _CMP_GT_OQ))) << (8 * v);
+        }
+        uint8_t mask = z_bits(xyz_bits);
+        if (check_texture)
+        {
+            const float* uv = texcoords + 2 * i;
+            uint32_t range_bits = 0;
+            for (int v = 0; v < 2; ++v)
+            {
+                __m256 in = _mm256_loadu_ps(uv + 8 * v);
+                __m256 in_range = _mm256_and_ps(_mm256_cmp_ps(in, zero, _CMP_GE_OQ), _mm256_cmp_ps(in, one, _CMP_LE_OQ));
+                range_bits |= static_cast<uint32_t>(_mm256_movemask_ps(in_range)) << (8 * v);
+            }
+            mask &= uv_bits(range_bits);
+        }
+        masks[i / 8] = mask;
+    }
+    valid_point_masks_scalar(vertices + 3 * i, texcoords + 2 * i, count - i, check_texture, masks + i / 8);
+}
+
+#endif
+
+#if defined(RS_KERNELS_NEON)
+
+// One bit per lane of a comparison result.
+inline uint32_t lane_bits_neon(uint32x4_t mask)
+{
+    const uint32_t weights[4] = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(mask, vld1q_u32(weights)));
+}
+
+void deproject_depth_neon(const uint16_t* depth, const float* ray_x, const float* ray_y, std::size_t count, float depth_unit, float* vertices)
+{
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const float32x4_t z = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vld1_u16(depth + i))), depth_unit);
+        float32x4x3_t xyz;
+        xyz.val[0] = vmulq_f32(vld1q_f32(ray_x + i), z);
+        xyz.val[1] = vmulq_f32(vld1q_f32(ray_y + i), z);
+        xyz.val[2] = z;
+        vst3q_f32(vertices + 3 * i, xyz);
+    }
+    deproject_depth_scalar(depth + i, ray_x + i, ray_y + i, count - i, depth_unit, vertices + 3 * i);
+}
+
+void crop_point_masks_neon(const float* vertices, std::size_t count, const crop_volume& crop, uint8_t* masks)
+{
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint32_t inside_bits = 0;
+        for (int half = 0; half < 2; ++half)
+        {
+            const float32x4x3_t xyz = vld3q_f32(vertices + 3 * (i + 4 * half));
+            const float32x4_t x = xyz.val[0];
+            const float32x4_t y = xyz.val[1];
+            const float32x4_t z = xyz.val[2];
+            uint32x4_t inside = vandq_u32(vcgeq_f32(z, vdupq_n_f32(crop.z_min)), vcleq_f32(z, vdupq_n_f32(crop.z_max)));
+            inside = vandq_u32(inside, vcleq_f32(vabsq_f32(x), vmulq_n_f32(z, crop.x_slope_max)));
+            inside = vandq_u32(inside, vcleq_f32(vabsq_f32(y), vmulq_n_f32(z, crop.y_slope_max)));
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const float* r = crop.rotation + 3 * axis;
+                float32x4_t b = vaddq_f32(vaddq_f32(vmulq_n_f32(x, r[0]), vmulq_n_f32(y, r[1])),
+                                          vaddq_f32(vmulq_n_f32(z, r[2]), vdupq_n_f32(crop.translation[axis])));
+                inside = vandq_u32(inside, vandq_u32(vcgeq_f32(b, vdupq_n_f32(crop.box_min[axis])), vcleq_f32(b, vdupq_n_f32(crop.box_max[axis]))));
+            }
+            inside_bits |= lane_bits_neon(inside) << (4 * half);
+        }
+        masks[i / 8] &= static_cast<uint8_t>(inside_bits);
+    }
+    crop_point_masks_scalar(vertices + 3 * i, count - i, crop, masks + i / 8);
+}
+
+void write_point_records_neon(const float* vertices, const uint8_t* masks, std::size_t count, uint8_t* out, std::size_t point_step)
+{
+    const float32x4_t nan = vdupq_n_f32(std::numeric_limits<float>::quiet_NaN());
+    std::size_t i = 0;
+    for (; i + 1 < count; ++i, out += point_step)
+    {
+        const bool valid = masks[i / 8] & (1 << (i % 8));
+        float32x4_t record = valid ? vld1q_f32(vertices + 3 * i) : nan;
+        vst1q_f32(reinterpret_cast<float*>(out), vsetq_lane_f32(0.f, record, 3));
+    }
+    if (i < count)
+    {
+        uint8_t last_mask = static_cast<uint8_t>(masks[i / 8] >> (i % 8));
+        write_point_records_scalar(vertices + 3 * i, &last_mask, 1, out, point_step);
+    }
+}
+
+void valid_point_masks_neon(const float* vertices, const float* texcoords, std::size_t count, bool check_texture, uint8_t* masks)
+{
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // vld3 and vld2 deinterleave the coordinates of 4 points.
+        uint32_t mask = 0;
+        for (int half = 0; half < 2; ++half)
+        {
+            const std::size_t p = i + 4 * half;
+            uint32x4_t valid = vcgtq_f32(vld3q_f32(vertices + 3 * p).val[2], zero);
+            if (check_texture)
+            {
+                float32x4x2_t uv = vld2q_f32(texcoords + 2 * p);
+                valid = vandq_u32(valid, vandq_u32(vcgeq_f32(uv.val[0], zero), vcleq_f32(uv.val[0], one)));
+                valid = vandq_u32(valid, vandq_u32(vcgeq_f32(uv.val[1], zero), vcleq_f32(uv.val[1], one)));
+            }
+            mask |= lane_bits_neon(valid) << (4 * half);
+        }
+        masks[i / 8] = static_cast<uint8_t>(mask);
+    }
+    valid_point_masks_scalar(vertices + 3 * i, texcoords + 2 * i, count - i, check_texture, masks + i / 8);
+}
+
+#endif
+
+}  // namespace
+
+const char* point_cloud_kernels_isa()
+{
+    switch (g_isa)
+    {
+        case kernel_isa::avx2: return "AVX2";
+        case kernel_isa::sse41: return "SSE4.1";
+        case kernel_isa::neon: return "NEON";
+        default: return "scalar";
+    }
+}
+
+bool set_point_cloud_kernels_isa(kernel_isa isa)
+{
+    if (!kernel_isa_supported(isa))
+        return false;
+    g_isa = isa;
+    return true;
+}
+
+void deproject_depth(const uint16_t* depth, const float* ray_x, const float* ray_y, std::size_t count, float depth_unit, float* vertices)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            deproject_depth_avx2(depth, ray_x, ray_y, count, depth_unit, vertices);
+            return;
+        case kernel_isa::sse41:
+            deproject_depth_sse41(depth, ray_x, ray_y, count, depth_unit, vertices);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            deproject_depth_neon(depth, ray_x, ray_y, count, depth_unit, vertices);
+            return;
+#endif
+        default:
+            deproject_depth_scalar(depth, ray_x, ray_y, count, depth_unit, vertices);
+    }
+}
+
+void depth_normals(const uint16_t* depth, const float* ray_x, const float* ray_y, int width, int height, int radius,
+                   float depth_unit, float max_depth_change, std::size_t begin, std::size_t count, float* normals)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            depth_normals_avx2(depth, ray_x, ray_y, width, height, radius, depth_unit, max_depth_change, begin, count, normals);
+            return;
+#endif
+        default:
+            depth_normals_scalar(depth, ray_x, ray_y, width, height, radius, depth_unit, max_depth_change, begin, count, normals);
+    }
+}
+
+void valid_point_masks(const float* vertices, const float* texcoords, std::size_t count, bool check_texture, uint8_t* masks)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            valid_point_masks_avx2(vertices, texcoords, count, check_texture, masks);
+            return;
+        case kernel_isa::sse41:
+            valid_point_masks_sse41(vertices, texcoords, count, check_texture, masks);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            valid_point_masks_neon(vertices, texcoords, count, check_texture, masks);
+            return;
+#endif
+        default:
+            valid_point_masks_scalar(vertices, texcoords, count, check_texture, masks);
+    }
+}
+
+void crop_point_masks(const float* vertices, std::size_t count, const crop_volume& crop, uint8_t* masks)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            crop_point_masks_avx2(vertices, count, crop, masks);
+            return;
+        case kernel_isa::sse41:
+            crop_point_masks_sse41(vertices, count, crop, masks);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            crop_point_masks_neon(vertices, count, crop, masks);
+            return;
+#endif
+        default:
+            crop_point_masks_scalar(vertices, count, crop, masks);
+    }
+}
+
+void texture_colors(const float* texcoords, std::size_t count, const uint8_t* texture, int width, int height,
+                    texture_format format, uint32_t* colors)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+            texture_colors_avx2(texcoords, count, texture, width, height, format, colors);
+            return;
+#endif
+        default:
+            texture_colors_scalar(texcoords, count, texture, width, height, format, colors);
+    }
+}
+
+void write_point_records(const float* vertices, const uint8_t* masks, std::size_t count, uint8_t* out, std::size_t point_step)
+{
+    switch (g_isa)
+    {
+#if defined(RS_KERNELS_X86)
+        case kernel_isa::avx2:
+        case kernel_isa::sse41:
+            write_point_records_sse41(vertices, masks, count, out, point_step);
+            return;
+#endif
+#if defined(RS_KERNELS_NEON)
+        case kernel_isa::neon:
+            write_point_records_neon(vertices, masks, count, out, point_step);
+            return;
+#endif
+        default:
+            write_point_records_scalar(vertices, masks, count, out, point_step);
+    }
+}
+
+}  // namespace realsense2_camera
@@ -0,0 +1,276 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/rvl_codec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace realsense2_camera
+{
+namespace rvl
+{
+
+namespace
+{
+
+const uint32_t MAGIC = 0x314C5652; // "RVL1"
+const std::size_t HEADER_WORDS = 4;
+
+// Band boundaries are derived from the image size, so the decoder needs no row table.
+inline int bandBegin(int height, int band_count, int band)
+{
+    return static_cast<int>(static_cast<int64_t>(height) * band / band_count);
+}
+
+// Every pixel costs at most one nibble for the run it belongs to and 6 nibbles for its delta,
+// plus two nibbles for the leading runs and a padding word.
+inline std::size_t maxBandSize(std::size_t pixels)
+{
+    return pixels * 4 + 8;
+}
+
+inline void writeWord(uint8_t* out, uint32_t word)
+{
+    out[0] = static_cast<uint8_t>(word);
+    out[1] = static_cast<uint8_t>(word >> 8);
+    out[2] = static_cast<uint8_t>(word >> 16);
+    out[3] = static_cast<uint8_t>(word >> 24);
+}
+
+inline uint32_t readWord(const uint8_t* in)
+{
+    return static_cast<uint32_t>(in[0]) | (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+class NibbleWriter
+{
+    public:
+        explicit NibbleWriter(uint8_t* out) : _begin(out), _out(out), _word(0), _nibbles(0) {}
+
+        // 3 value bits per nibble, the 4th bit tells that more nibbles follow.
+        void write(uint32_t value)
+        {
+            do
+            {
+                uint32_t nibble = value & 0x7;
+                value >>= 3;
+                if (value)
+                    nibble |= 0x8;
+                _word = (_word << 4) | nibble;
+                if (++_nibbles == 8)
+                {
+                    writeWord(_out, _word);
+                    _out += 4;
+                    _word = 0;
+                    _nibbles = 0;
+                }
+            } while (value);
+        }
+
+        std::size_t finish()
+        {
+            if (_nibbles)
+            {
+                writeWord(_out, _word << (4 * (8 - _nibbles)));
+                _out += 4;
+            }
+            return _out - _begin;
+        }
+
+    private:
+        uint8_t* _begin;
+        uint8_t* _out;
+        uint32_t _word;
+        int _nibbles;
+};
+
+class NibbleReader
+{
+    public:
+        NibbleReader(const uint8_t* in, std::size_t size) : _in(in), _end(in + size), _word(0), _nibbles(0) {}
+
+        bool read(uint32_t& value)
+        {
+            value = 0;
+            int shift = 0;
+            uint32_t nibble;
+            do
+            {
+                if (!_nibbles)
+                {
+                    if (_end - _in < 4)
+                        return false;
+                    _word = readWord(_in);
+                    _in += 4;
+                    _nibbles = 8;
+                }
+                nibble = _word >> 28;
+                _word <<= 4;
+                --_nibbles;
+                if (shift > 30)
+                    return false;
+                value |= (nibble & 0x7) << shift;
+                shift += 3;
+            } while (nibble & 0x8);
+            return true;
+        }
+
+    private:
+        const uint8_t* _in;
+        const uint8_t* _end;
+        uint32_t _word;
+        int _nibbles;
+};
+
+std::size_t encodeBand(const uint16_t* depth, std::size_t count, uint8_t* out)
+{
+    NibbleWriter writer(out);
+    const uint16_t* end = depth + count;
+    int32_t previous = 0;
+    while (depth != end)
+    {
+        const uint16_t* run = depth;
+        while (depth != end && *depth == 0)
+            ++depth;
+        writer.write(static_cast<uint32_t>(depth - run));
+
+        run = depth;
+        while (depth != end && *depth != 0)
+            ++depth;
+        writer.write(static_cast<uint32_t>(depth - run));
+
+        for (; run != depth; ++run)
+        {
+            int32_t delta = static_cast<int32_t>(*run) - previous;
+            writer.write(static_cast<uint32_t>((delta << 1) ^ (delta >> 31)));
+            previous = *run;
+        }
+    }
+    return writer.finish();
+}
+
+bool decodeBand(const uint8_t* data, std::size_t size, uint16_t* depth, std::size_t count)
+{
+    NibbleReader reader(data, size);
+    uint16_t* end = depth + count;
+    int32_t previous = 0;
+    while (depth != end)
+    {
+        uint32_t zeros, values;
+        if (!reader.read(zeros) || zeros > static_cast<std::size_t>(end - depth))
+            return false;
+        std::fill(depth, depth + zeros, 0);
+        depth += zeros;
+
+        if (!reader.read(values) || values > static_cast<std::size_t>(end - depth))
+            return false;
+        for (uint32_t i = 0; i < values; ++i)
+        {
+            uint32_t zigzag;
+            if (!reader.read(zigzag))
+                return false;
+            previous += static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+            *depth++ = static_cast<uint16_t>(previous);
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+Encoder::Encoder(int band_count, int threads) :
+    _band_count(std::max(band_count, 1)), _pool(std::max(threads, 1))
+{}
+
+void Encoder::encode(const uint16_t* depth, int width, int height, std::vector<uint8_t>& out)
+{
+    const int band_count = std::max(std::min(_band_count, height), 1);
+    const std::size_t max_band_size = maxBandSize(static_cast<std::size_t>(width) * ((height + band_count - 1) / band_count));
+    if (_buffer.size() < max_band_size * band_count)
+        _buffer.resize(max_band_size * band_count);
+    _band_sizes.resize(band_count);
+
+    _pool.run(band_count, [&](int band)
+    {
+        const int begin = bandBegin(height, band_count, band);
+        const int end = bandBegin(height, band_count, band + 1);
+        _band_sizes[band] = encodeBand(depth + static_cast<std::size_t>(begin) * width,
+                                       static_cast<std::size_t>(end - begin) * width,
+                                       _buffer.data() + band * max_band_size);
+    });
+
+    std::size_t header_size = (HEADER_WORDS + band_count) * 4;
+    std::size_t total_size = header_size;
+    for (std::size_t band_size : _band_sizes)
+        total_size += band_size;
+    out.resize(total_size);
+
+    uint8_t* p = out.data();
+    writeWord(p, MAGIC);
+    writeWord(p + 4, static_cast<uint32_t>(width));
+    writeWord(p + 8, static_cast<uint32_t>(height));
+    writeWord(p + 12, static_cast<uint32_t>(band_count));
+    p += HEADER_WORDS * 4;
+    for (std::size_t band_size : _band_sizes)
+    {
+        writeWord(p, static_cast<uint32_t>(band_size));
+        p += 4;
+    }
+    for (int band = 0; band < band_count; band++)
+    {
+        memcpy(p, _buffer.data() + band * max_band_size, _band_sizes[band]);
+        p += _band_sizes[band];
+    }
+}
+
+bool decode(const uint8_t* data, std::size_t size, std::vector<uint16_t>& depth, int& width, int& height,
+            WorkerPool* pool)
+{
+    if (size < HEADER_WORDS * 4 || readWord(data) != MAGIC)
+        return false;
+    const uint32_t image_width = readWord(data + 4);
+    const uint32_t image_height = readWord(data + 8);
+    const uint32_t band_count = readWord(data + 12);
+    if (band_count == 0 || band_count > std::max<uint32_t>(image_height, 1) ||
+        size < (HEADER_WORDS + band_count) * 4 || image_width > (1u << 16) || image_height > (1u << 16))
+        return false;
+
+    std::vector<std::size_t> offsets(band_count + 1);
+    offsets[0] = (HEADER_WORDS + band_count) * 4;
+    for (uint32_t band = 0; band < band_count; band++)
+    {
+        offsets[band + 1] = offsets[band] + readWord(data + (HEADER_WORDS + band) * 4);
+        if (offsets[band + 1] > size)
+            return false;
+    }
+
+    width = static_cast<int>(image_width);
+    height = static_cast<int>(image_height);
+    depth.resize(static_cast<std::size_t>(width) * height);
+
+    std::atomic<bool> valid(true);
+    auto decode_band = [&](int band)
+    {
+        const int begin = bandBegin(height, band_count, band);
+        const int end = bandBegin(height, band_count, band + 1);
+        if (!decodeBand(data + offsets[band], offsets[band + 1] - offsets[band],
+                        depth.data() + static_cast<std::size_t>(begin) * width,
+                        static_cast<std::size_t>(end - begin) * width))
+            valid = false;
+    };
+    if (pool)
+    {
+        pool->run(static_cast<int>(band_count), decode_band);
+    }
+    else
+    {
+        for (int band = 0; band < static_cast<int>(band_count); band++)
+            decode_band(band);
+    }
+    return valid;
+}
+
+}  // namespace rvl
+}  // namespace realsense2_camera
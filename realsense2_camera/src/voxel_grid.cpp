@@ -0,0 +1,172 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/voxel_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace realsense2_camera
+{
+
+namespace
+{
+
+const uint64_t EMPTY_KEY = ~uint64_t(0);
+const int KEY_BITS = 21;
+const int64_t KEY_MASK = (int64_t(1) << KEY_BITS) - 1;
+
+// Voxel coordinates wrap after 2^21 voxels, far beyond the range of the camera.
+inline uint64_t voxelKey(const float* xyz, float inverse_size)
+{
+    uint64_t key = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        const int64_t coordinate = static_cast<int64_t>(std::floor(xyz[axis] * inverse_size));
+        key = (key << KEY_BITS) | static_cast<uint64_t>(coordinate & KEY_MASK);
+    }
+    return key;
+}
+
+inline uint64_t hashKey(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+}  // namespace
+
+VoxelGrid::VoxelGrid(float voxel_size, Policy policy, int threads) :
+    _inverse_size(1.f / voxel_size),
+    _policy(policy),
+    _pool(std::min(std::max(threads, 1), 255)),
+    _partitions(_pool.size())
+{
+}
+
+std::size_t VoxelGrid::downsample(std::vector<uint8_t>& records, std::size_t point_step, int color_offset)
+{
+    const std::size_t count = records.size() / point_step;
+    const int partition_count = static_cast<int>(_partitions.size());
+    _keys.resize(count);
+    _owners.resize(count);
+
+    // Keys and owning partitions of the points, over ranges of points.
+    const uint8_t* in = records.data();
+    _pool.run(partition_count, [&](int range)
+    {
+        const std::size_t begin = count * range / partition_count;
+        const std::size_t end = count * (range + 1) / partition_count;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            float xyz[3];
+            memcpy(xyz, in + i * point_step, sizeof(xyz));
+            _keys[i] = voxelKey(xyz, _inverse_size);
+            _owners[i] = static_cast<uint8_t>(hashKey(_keys[i]) % partition_count);
+        }
+    });
+
+    _pool.run(partition_count, [&](int p)
+    {
+        accumulate(_partitions[p], p, in, count, point_step, color_offset);
+    });
+
+    std::size_t voxel_count = 0;
+    for (Partition& partition : _partitions)
+    {
+        partition.output = voxel_count;
+        voxel_count += partition.voxels.size();
+    }
+
+    _output.resize(voxel_count * point_step);
+    _pool.run(partition_count, [&](int p)
+    {
+        const Partition& partition = _partitions[p];
+        uint8_t* out = _output.data() + partition.output * point_step;
+        for (const Voxel& voxel : partition.voxels)
+        {
+            memcpy(out, in + static_cast<std::size_t>(voxel.first) * point_step, point_step);
+            if (_policy == Policy::centroid && voxel.count > 1)
+            {
+                const float xyz[3] = {static_cast<float>(voxel.sum[0] / voxel.count),
+                                      static_cast<float>(voxel.sum[1] / voxel.count),
+                                      static_cast<float>(voxel.sum[2] / voxel.count)};
+                memcpy(out, xyz, sizeof(xyz));
+                if (color_offset >= 0)
+                {
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        out[color_offset + c] = static_cast<uint8_t>((voxel.color_sum[c] + voxel.count / 2) / voxel.count);
+                    }
+                }
+            }
+            out += point_step;
+        }
+    });
+
+    // The input buffer is kept for the output of the next call.
+    records.swap(_output);
+    return voxel_count;
+}
+
+void VoxelGrid::accumulate(Partition& partition, int index, const uint8_t* records, std::size_t count,
+                           std::size_t point_step, int color_offset)
+{
+    std::size_t point_count = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        point_count += (_owners[i] == index);
+    }
+
+    // Open addressing, at most half full.
+    std::size_t capacity = 16;
+    while (capacity < 2 * point_count)
+        capacity *= 2;
+    const std::size_t mask = capacity - 1;
+    partition.keys.assign(capacity, EMPTY_KEY);
+    partition.slots.resize(capacity);
+    partition.voxels.clear();
+
+    const bool sum = (_policy == Policy::centroid);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (_owners[i] != index)
+            continue;
+        const uint64_t key = _keys[i];
+        std::size_t slot = (hashKey(key) >> 8) & mask;
+        while (partition.keys[slot] != key && partition.keys[slot] != EMPTY_KEY)
+            slot = (slot + 1) & mask;
+        if (partition.keys[slot] == EMPTY_KEY)
+        {
+            partition.keys[slot] = key;
+            partition.slots[slot] = static_cast<uint32_t>(partition.voxels.size());
+            partition.voxels.push_back(Voxel());
+            Voxel& voxel = partition.voxels.back();
+            memset(&voxel, 0, sizeof(voxel));
+            voxel.first = static_cast<uint32_t>(i);
+        }
+        Voxel& voxel = partition.voxels[partition.slots[slot]];
+        ++voxel.count;
+        if (sum)
+        {
+            const uint8_t* record = records + i * point_step;
+            float xyz[3];
+            memcpy(xyz, record, sizeof(xyz));
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                voxel.sum[axis] += xyz[axis];
+            }
+            if (color_offset >= 0)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    voxel.color_sum[c] += record[color_offset + c];
+                }
+            }
+        }
+    }
+}
+
+}  // namespace realsense2_camera
@@ -0,0 +1,134 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/image_kernels.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    // Instruction sets of the kernels that can run on this CPU.
+    std::vector<kernel_isa> supportedIsas()
+    {
+        std::vector<kernel_isa> isas;
+        for (kernel_isa isa : {kernel_isa::scalar, kernel_isa::sse41, kernel_isa::avx2, kernel_isa::neon})
+        {
+            if (kernel_isa_supported(isa))
+                isas.push_back(isa);
+        }
+        return isas;
+    }
+
+    class ImageKernels : public testing::TestWithParam<kernel_isa>
+    {
+        protected:
+            void SetUp() override
+            {
+                ASSERT_TRUE(set_image_kernels_isa(GetParam()));
+                for (int value = 0; value < 65536; ++value)
+                    all_values.push_back(static_cast<uint16_t>(value));
+            }
+
+            void TearDown() override
+            {
+                set_image_kernels_isa(detect_kernel_isa());
+            }
+
+            std::vector<uint16_t> all_values;
+    };
+
+    const float ROS_DEPTH_SCALE = 0.001f;
+    const float DEPTH_SCALES[] = {0.0001f, 0.00025f, 0.001f};
+    const uint16_t CLIPPING_VALUES[] = {1, 1000, 4000, 65534, 65535};
+
+    // What fix_depth_scale() computed for a pixel before the kernels:
+    // static_cast<uint16_t>(p_from[j] * _depth_scale_meters / 0.001f).
+    uint16_t baselineRescale(uint16_t value, float depth_scale_meters)
+    {
+        return static_cast<uint16_t>(value * depth_scale_meters / 0.001f);
+    }
+
+    // What clip_depth() did to a pixel before the kernels.
+    uint16_t baselineClip(uint16_t value, uint16_t clipping_value)
+    {
+        return (value > clipping_value) ? 0 : value;
+    }
+
+    // Runs kernel on every range of values of the odd sizes SIMD kernels handle in their tail,
+    // from odd offsets, and on all the values at once, then checks every output against expected.
+    template <typename Kernel, typename Expected>
+    void expectAllValues(const std::vector<uint16_t>& values, Kernel kernel, Expected expected)
+    {
+        std::vector<uint16_t> out(values.size());
+        kernel(values.data(), out.data(), values.size());
+        for (std::size_t i = 0; i < values.size(); ++i)
+            ASSERT_EQ(expected(values[i]), out[i]) << "value " << values[i];
+
+        for (std::size_t count : {1, 3, 7, 9, 15, 17, 31, 33, 47})
+        {
+            for (std::size_t begin : {std::size_t(1), std::size_t(65535) - count})
+            {
+                std::vector<uint16_t> tail(count + 2, 0xABCD);
+                kernel(values.data() + begin, tail.data() + 1, count);
+                EXPECT_EQ(0xABCD, tail.front());
+                EXPECT_EQ(0xABCD, tail.back()) << count << " values written past the end";
+                for (std::size_t i = 0; i < count; ++i)
+                    ASSERT_EQ(expected(values[begin + i]), tail[i + 1]) << count << " values from " << begin;
+            }
+        }
+
+        // In place, as the node clips depth frames.
+        std::vector<uint16_t> in_place(values);
+        kernel(in_place.data(), in_place.data(), in_place.size());
+        EXPECT_TRUE(in_place == out);
+    }
+}
+
+TEST_P(ImageKernels, rescaleDepthMatchesBaseline)  // NOLINT
+{
+    for (float scale : DEPTH_SCALES)
+    {
+        SCOPED_TRACE(testing::Message() << "depth scale " << scale);
+        expectAllValues(all_values,
+                        [&](const uint16_t* src, uint16_t* dst, std::size_t count) { rescale_depth(src, dst, count, scale, ROS_DEPTH_SCALE); },
+                        [&](uint16_t value) { return baselineRescale(value, scale); });
+    }
+}
+
+TEST_P(ImageKernels, clipDepthRangeMatchesBaseline)  // NOLINT
+{
+    for (uint16_t clipping_value : CLIPPING_VALUES)
+    {
+        SCOPED_TRACE(testing::Message() << "clipping value " << clipping_value);
+        expectAllValues(all_values,
+                        [&](const uint16_t* src, uint16_t* dst, std::size_t count) { clip_depth_range(src, dst, count, 0, clipping_value); },
+                        [&](uint16_t value) { return baselineClip(value, clipping_value); });
+    }
+
+    // With clip_distance_min as well, values below the minimum are zeroed too.
+    expectAllValues(all_values,
+                    [](const uint16_t* src, uint16_t* dst, std::size_t count) { clip_depth_range(src, dst, count, 300, 4000); },
+                    [](uint16_t value) { return (value < 300) ? 0 : baselineClip(value, 4000); });
+}
+
+TEST_P(ImageKernels, clipRescaleDepthMatchesBaseline)  // NOLINT
+{
+    for (float scale : DEPTH_SCALES)
+    {
+        for (uint16_t clipping_value : CLIPPING_VALUES)
+        {
+            SCOPED_TRACE(testing::Message() << "depth scale " << scale << ", clipping value " << clipping_value);
+            expectAllValues(all_values,
+                            [&](const uint16_t* src, uint16_t* dst, std::size_t count)
+                            {
+                                clip_rescale_depth(src, dst, count, 0, clipping_value, scale, ROS_DEPTH_SCALE);
+                            },
+                            [&](uint16_t value) { return baselineRescale(baselineClip(value, clipping_value), scale); });
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(SupportedIsas, ImageKernels, testing::ValuesIn(supportedIsas()));  // NOLINT
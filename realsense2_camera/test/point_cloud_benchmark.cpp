@@ -0,0 +1,294 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/point_cloud_builder.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int WIDTH = 848;
+    const int HEIGHT = 480;
+    const int FRAMES = 50;
+    const std::size_t POINT_STEP = 16;
+
+    // A slanted wall in front of a D435 at 848x480, with a hole every few pixels and a band of
+    // missing depth, like the shadows of a real depth image.
+    struct SyntheticDepth
+    {
+        SyntheticDepth() : depth(WIDTH * HEIGHT)
+        {
+            rs2_intrinsics intrinsics = rs2_intrinsics();
+            intrinsics.width = WIDTH;
+            intrinsics.height = HEIGHT;
+            intrinsics.ppx = 424.f;
+            intrinsics.ppy = 240.f;
+            intrinsics.fx = 425.f;
+            intrinsics.fy = 425.f;
+            intrinsics.model = RS2_DISTORTION_BROWN_CONRADY;
+            deprojector.setIntrinsics(intrinsics);
+            for (int y = 0; y < HEIGHT; ++y)
+            {
+                for (int x = 0; x < WIDTH; ++x)
+                {
+                    const bool hole = ((x * 7 + y * 13) % 11 == 0) || (x > 300 && x < 340);
+                    depth[y * WIDTH + x] = hole ? 0 : static_cast<uint16_t>(1000 + 2 * x + y);
+                }
+            }
+        }
+
+        DepthDeprojector deprojector;
+        std::vector<uint16_t> depth;
+    };
+
+    // Points with depth, as x, y, z and padding, as the node writes them without a texture.
+    std::size_t buildChunk(std::size_t, std::size_t count, const float* vertices, bool ordered, uint8_t* out)
+    {
+        uint8_t masks[PointCloudBuilder::CHUNK_SIZE / 8];
+        valid_point_masks(vertices, nullptr, count, false, masks);
+        std::size_t points = 0;
+        for (std::size_t byte = 0; byte < (count + 7) / 8; ++byte)
+            points += __builtin_popcount(masks[byte]);
+        if (!out)
+            return points;
+        if (ordered)
+        {
+            write_point_records(vertices, masks, count, out, POINT_STEP);
+            return points;
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (!((masks[i / 8] >> (i % 8)) & 1))
+                continue;
+            const float record[4] = {vertices[3 * i], vertices[3 * i + 1], vertices[3 * i + 2], 0.f};
+            memcpy(out, record, sizeof(record));
+            out += POINT_STEP;
+        }
+        return points;
+    }
+
+    // Vertices and texture coordinates of an 848x480 cloud as librealsense computes them, about 80%
+    // of the points having depth and a few of those falling out of the texture, and an RGB texture.
+    struct SyntheticPoints
+    {
+        SyntheticPoints() : vertices(3 * WIDTH * HEIGHT), texcoords(2 * WIDTH * HEIGHT), texture(3 * WIDTH * HEIGHT)
+        {
+            std::mt19937 random(42);
+            std::uniform_real_distribution<float> coordinate(-1.f, 1.f);
+            std::uniform_real_distribution<float> texcoord(-0.05f, 0.999f);
+            for (std::size_t i = 0; i < WIDTH * HEIGHT; ++i)
+            {
+                const bool has_depth = random() % 5 != 0;
+                vertices[3 * i] = coordinate(random);
+                vertices[3 * i + 1] = coordinate(random);
+                vertices[3 * i + 2] = has_depth ? 0.5f + (coordinate(random) + 1.f) : 0.f;
+                texcoords[2 * i] = texcoord(random);
+                texcoords[2 * i + 1] = texcoord(random);
+            }
+            for (uint8_t& byte : texture)
+                byte = static_cast<uint8_t>(random());
+        }
+
+        std::vector<float> vertices;
+        std::vector<float> texcoords;
+        std::vector<uint8_t> texture;
+    };
+
+    // x, y, z, padding and rgb, as in the messages of the node with an RGB texture.
+    const std::size_t TEXTURED_POINT_STEP = 20;
+    const std::size_t COLOR_OFFSET = 16;
+
+    // The implementation publishPointCloud() had before its single pass: the indices of the valid
+    // points are collected in a std::list, which is then walked to write the points and their
+    // colors. The PointCloud2Iterators it wrote through are replaced by the same strided writes.
+    void listCompaction(const SyntheticPoints& points, bool allow_no_texture_points, std::vector<uint8_t>& data)
+    {
+        const float* vertex = points.vertices.data();
+        const float* color_point = points.texcoords.data();
+        std::list<unsigned int> valid_indices;
+        for (std::size_t point_idx = 0; point_idx < WIDTH * HEIGHT; point_idx++, vertex += 3, color_point += 2)
+        {
+            if (vertex[2] > 0)
+            {
+                float i = color_point[0];
+                float j = color_point[1];
+                if (allow_no_texture_points || (i >= 0.f && i <= 1.f && j >= 0.f && j <= 1.f))
+                {
+                    valid_indices.push_back(point_idx);
+                }
+            }
+        }
+
+        data.clear();
+        data.resize(valid_indices.size() * TEXTURED_POINT_STEP);
+        uint8_t* out = data.data();
+        vertex = points.vertices.data();
+        color_point = points.texcoords.data();
+        unsigned int prev_idx(0);
+        for (auto idx = valid_indices.begin(); idx != valid_indices.end(); idx++, out += TEXTURED_POINT_STEP)
+        {
+            unsigned int idx_jump(*idx - prev_idx);
+            prev_idx = *idx;
+            vertex += 3 * idx_jump;
+            color_point += 2 * idx_jump;
+            memcpy(out, vertex, 3 * sizeof(float));
+
+            float i(color_point[0]);
+            float j(color_point[1]);
+            if (i >= 0.f && i <= 1.f && j >= 0.f && j <= 1.f)
+            {
+                int pixx = static_cast<int>(i * WIDTH);
+                int pixy = static_cast<int>(j * HEIGHT);
+                const uint8_t* rgb = points.texture.data() + (pixy * WIDTH + pixx) * 3;
+                for (int c = 0; c < 3; ++c)
+                    out[COLOR_OFFSET + c] = rgb[2 - c];  // PointCloud2 order of rgb is bgr.
+            }
+        }
+    }
+
+    // The single pass: validity masks and colors of chunks of points computed with SIMD, and the
+    // valid points written straight into a buffer sized for every point, shrunk once.
+    void singlePassCompaction(const SyntheticPoints& points, bool allow_no_texture_points, std::vector<uint8_t>& data)
+    {
+        const std::size_t CHUNK_SIZE = PointCloudBuilder::CHUNK_SIZE;
+        uint32_t colors[CHUNK_SIZE];
+        uint8_t masks[CHUNK_SIZE / 8];
+        data.resize(WIDTH * HEIGHT * TEXTURED_POINT_STEP);
+        uint8_t* out = data.data();
+        for (std::size_t chunk = 0; chunk < WIDTH * HEIGHT; chunk += CHUNK_SIZE)
+        {
+            const std::size_t count = std::min<std::size_t>(CHUNK_SIZE, WIDTH * HEIGHT - chunk);
+            const float* vertices = points.vertices.data() + 3 * chunk;
+            const float* texcoords = points.texcoords.data() + 2 * chunk;
+            valid_point_masks(vertices, texcoords, count, !allow_no_texture_points, masks);
+            texture_colors(texcoords, count, points.texture.data(), WIDTH, HEIGHT, texture_format::rgb8, colors);
+            for (std::size_t byte = 0; byte < (count + 7) / 8; ++byte)
+            {
+                for (unsigned int bits = masks[byte]; bits != 0; bits &= bits - 1)
+                {
+                    const std::size_t offset = byte * 8 + __builtin_ctz(bits);
+                    const float record[4] = {vertices[3 * offset], vertices[3 * offset + 1], vertices[3 * offset + 2], 0.f};
+                    memcpy(out, record, sizeof(record));
+                    memcpy(out + COLOR_OFFSET, colors + offset, sizeof(uint32_t));
+                    out += TEXTURED_POINT_STEP;
+                }
+            }
+        }
+        data.resize(out - data.data());
+    }
+
+    template <typename Function>
+    double millisecondsPerFrame(Function function)
+    {
+        function();
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FRAMES; ++i)
+            function();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / FRAMES;
+    }
+
+    std::vector<int> threadCounts()
+    {
+        const int max_threads = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+        std::vector<int> counts;
+        for (int threads = 1; threads <= max_threads; threads *= 2)
+            counts.push_back(threads);
+        return counts;
+    }
+}
+
+TEST(PointCloudBuilder, sameCloudForAnyThreadCount)  // NOLINT
+{
+    const SyntheticDepth frame;
+    std::vector<uint8_t> expected;
+    for (std::size_t i = 0; i < frame.depth.size(); ++i)
+    {
+        if (!frame.depth[i])
+            continue;
+        float vertex[3];
+        frame.deprojector.deproject(frame.depth.data(), i, 1, 0.001f, vertex);
+        const float record[4] = {vertex[0], vertex[1], vertex[2], 0.f};
+        expected.insert(expected.end(), reinterpret_cast<const uint8_t*>(record),
+                        reinterpret_cast<const uint8_t*>(record) + sizeof(record));
+    }
+
+    for (int threads : threadCounts())
+    {
+        PointCloudBuilder builder(threads);
+        std::vector<uint8_t> data;
+        const std::size_t points = builder.build(frame.deprojector, frame.depth.data(), 0.001f, POINT_STEP, false,
+                                                 buildChunk, data);
+        EXPECT_EQ(expected.size() / POINT_STEP, points) << threads << " threads";
+        EXPECT_TRUE(data == expected) << threads << " threads";
+
+        std::vector<uint8_t> ordered_data;
+        EXPECT_EQ(frame.depth.size(), builder.build(frame.deprojector, frame.depth.data(), 0.001f, POINT_STEP, true,
+                                                    buildChunk, ordered_data));
+        ASSERT_EQ(frame.depth.size() * POINT_STEP, ordered_data.size());
+        for (std::size_t i = 0, point = 0; i < frame.depth.size(); ++i)
+        {
+            if (!frame.depth[i])
+                continue;
+            ASSERT_EQ(0, memcmp(&ordered_data[i * POINT_STEP], &expected[point++ * POINT_STEP], POINT_STEP)) << i;
+        }
+    }
+}
+
+// Time per 848x480 frame of unorganized and organized clouds from 1 to N threads. The speedup
+// depends on the cores of the machine, so it is printed rather than checked.
+TEST(PointCloudBuilder, threadScaling)  // NOLINT
+{
+    const SyntheticDepth frame;
+    std::vector<uint8_t> data;
+    double single_thread_ms[2] = {0., 0.};
+    for (int threads : threadCounts())
+    {
+        PointCloudBuilder builder(threads);
+        for (int ordered = 0; ordered < 2; ++ordered)
+        {
+            const double ms = millisecondsPerFrame([&]
+            {
+                builder.build(frame.deprojector, frame.depth.data(), 0.001f, POINT_STEP, ordered, buildChunk, data);
+            });
+            if (threads == 1)
+                single_thread_ms[ordered] = ms;
+            printf("%s cloud, %d thread(s): %.2f ms per frame, speedup %.2f\n", ordered ? "organized" : "unorganized",
+                   threads, ms, single_thread_ms[ordered] / ms);
+        }
+    }
+    printf("(%u hardware threads)\n", std::thread::hardware_concurrency());
+}
+
+TEST(PointCloudCompaction, sameCloudAsListImplementation)  // NOLINT
+{
+    const SyntheticPoints points;
+    for (bool allow_no_texture_points : {false, true})
+    {
+        std::vector<uint8_t> expected, data;
+        listCompaction(points, allow_no_texture_points, expected);
+        singlePassCompaction(points, allow_no_texture_points, data);
+        EXPECT_EQ(expected.size(), data.size()) << "allow_no_texture_points " << allow_no_texture_points;
+        EXPECT_TRUE(data == expected) << "allow_no_texture_points " << allow_no_texture_points;
+    }
+}
+
+// Time per 848x480 textured cloud of the std::list implementation and of the single pass.
+TEST(PointCloudCompaction, listVersusSinglePass)  // NOLINT
+{
+    const SyntheticPoints points;
+    std::vector<uint8_t> data;
+    const double list_ms = millisecondsPerFrame([&] { listCompaction(points, false, data); });
+    const double single_pass_ms = millisecondsPerFrame([&] { singlePassCompaction(points, false, data); });
+    printf("std::list: %.2f ms per frame, single pass (%s): %.2f ms per frame, speedup %.2f\n", list_ms,
+           point_cloud_kernels_isa(), single_pass_ms, list_ms / single_pass_ms);
+}
@@ -0,0 +1,255 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/point_cloud_kernels.h"
+
+#include <gtest/gtest.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const float NaN = std::numeric_limits<float>::quiet_NaN();
+    const float INF = std::numeric_limits<float>::infinity();
+
+    // Point counts around the 4 and 8 lanes of the SIMD kernels, and the 1024 points of a chunk.
+    const std::size_t COUNTS[] = {1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 1000, 1023, 1024};
+
+    std::vector<kernel_isa> supportedIsas()
+    {
+        std::vector<kernel_isa> isas;
+        for (kernel_isa isa : {kernel_isa::scalar, kernel_isa::sse41, kernel_isa::avx2, kernel_isa::neon})
+        {
+            if (kernel_isa_supported(isa))
+                isas.push_back(isa);
+        }
+        return isas;
+    }
+
+    // Bytes of size ending right before an inaccessible page, so that reading past them crashes.
+    class GuardedBuffer
+    {
+        public:
+            explicit GuardedBuffer(std::size_t size) : _page(sysconf(_SC_PAGESIZE))
+            {
+                _length = ((size + _page - 1) / _page + 1) * _page;
+                _base = static_cast<uint8_t*>(mmap(nullptr, _length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+                mprotect(_base + _length - _page, _page, PROT_NONE);
+                data = _base + _length - _page - size;
+            }
+
+            ~GuardedBuffer() { munmap(_base, _length); }
+
+            uint8_t* data;
+
+        private:
+            const std::size_t _page;
+            std::size_t _length;
+            uint8_t* _base;
+    };
+
+    // Floats are compared bit by bit, except that any NaN matches any NaN.
+    void expectSameFloats(const std::vector<float>& expected, const std::vector<float>& actual)
+    {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (std::size_t i = 0; i < expected.size(); ++i)
+        {
+            if (std::isnan(expected[i]) && std::isnan(actual[i]))
+                continue;
+            ASSERT_EQ(0, memcmp(&expected[i], &actual[i], sizeof(float))) << "float " << i << ": " << expected[i] << " != " << actual[i];
+        }
+    }
+
+    // Runs every kernel with the variant of the instruction set under test and with the scalar
+    // reference, on the same input.
+    class PointCloudKernels : public testing::TestWithParam<kernel_isa>
+    {
+        protected:
+            void SetUp() override { ASSERT_TRUE(set_point_cloud_kernels_isa(GetParam())); }
+            void TearDown() override { set_point_cloud_kernels_isa(detect_kernel_isa()); }
+
+            template <typename Kernel>
+            void withScalar(Kernel kernel)
+            {
+                set_point_cloud_kernels_isa(kernel_isa::scalar);
+                kernel();
+                set_point_cloud_kernels_isa(GetParam());
+            }
+
+            std::mt19937 random{42};
+    };
+
+    // Values a point coordinate or texture coordinate is picked from: the limits of the ranges,
+    // NaN, infinities, and values just out of [0, 1].
+    float specialValue(std::mt19937& random)
+    {
+        const float values[] = {0.f, -0.f, 1.f, NaN, INF, -INF, -1e-6f, 1.f + 1e-6f, 0.5f, 0.999999f, -2.f, 3.f};
+        return values[random() % (sizeof(values) / sizeof(values[0]))];
+    }
+
+    std::vector<float> randomFloats(std::mt19937& random, std::size_t count)
+    {
+        std::uniform_real_distribution<float> value(-0.5f, 1.5f);
+        std::vector<float> floats(count);
+        for (float& f : floats)
+            f = (random() % 4 == 0) ? specialValue(random) : value(random);
+        return floats;
+    }
+}
+
+TEST_P(PointCloudKernels, deprojectDepth)  // NOLINT
+{
+    for (std::size_t count : COUNTS)
+    {
+        std::vector<uint16_t> depth(count);
+        for (uint16_t& d : depth)
+            d = (random() % 5 == 0) ? 0 : (random() % 10 == 0) ? 65535 : static_cast<uint16_t>(random());
+        const std::vector<float> ray_x = randomFloats(random, count);
+        const std::vector<float> ray_y = randomFloats(random, count);
+        std::vector<float> expected(3 * count), actual(3 * count);
+        withScalar([&] { deproject_depth(depth.data(), ray_x.data(), ray_y.data(), count, 0.001f, expected.data()); });
+        deproject_depth(depth.data(), ray_x.data(), ray_y.data(), count, 0.001f, actual.data());
+        SCOPED_TRACE(testing::Message() << count << " points");
+        expectSameFloats(expected, actual);
+    }
+}
+
+TEST_P(PointCloudKernels, validPointMasks)  // NOLINT
+{
+    for (std::size_t count : COUNTS)
+    {
+        const std::vector<float> vertices = randomFloats(random, 3 * count);
+        const std::vector<float> texcoords = randomFloats(random, 2 * count);
+        for (bool check_texture : {false, true})
+        {
+            std::vector<uint8_t> expected((count + 7) / 8, 0xAA), actual((count + 7) / 8, 0x55);
+            withScalar([&] { valid_point_masks(vertices.data(), texcoords.data(), count, check_texture, expected.data()); });
+            valid_point_masks(vertices.data(), texcoords.data(), count, check_texture, actual.data());
+            EXPECT_TRUE(expected == actual) << count << " points, check_texture " << check_texture;
+        }
+    }
+}
+
+TEST_P(PointCloudKernels, cropPointMasks)  // NOLINT
+{
+    std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+    for (std::size_t count : COUNTS)
+    {
+        std::vector<float> vertices = randomFloats(random, 3 * count);
+        for (float& v : vertices)
+            v *= 4.f;
+        std::vector<uint8_t> masks((count + 7) / 8);
+        for (uint8_t& m : masks)
+            m = static_cast<uint8_t>(random());
+
+        // A rotated box with finite limits, and one with unused (infinite) limits.
+        const float a = angle(random);
+        crop_volume boxed = {{std::cos(a), -std::sin(a), 0.f, std::sin(a), std::cos(a), 0.f, 0.f, 0.f, 1.f},
+                             {0.1f, -0.2f, 0.3f}, {-1.f, -1.5f, 0.5f}, {2.f, 1.f, 4.f}, 0.2f, 5.f, 0.8f, 0.6f};
+        crop_volume unbounded = {{1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f}, {0.f, 0.f, 0.f},
+                                 {-INF, -INF, -INF}, {INF, INF, INF}, -INF, INF, INF, INF};
+        for (const crop_volume& crop : {boxed, unbounded})
+        {
+            std::vector<uint8_t> expected(masks), actual(masks);
+            withScalar([&] { crop_point_masks(vertices.data(), count, crop, expected.data()); });
+            crop_point_masks(vertices.data(), count, crop, actual.data());
+            EXPECT_TRUE(expected == actual) << count << " points";
+        }
+    }
+}
+
+TEST_P(PointCloudKernels, textureColors)  // NOLINT
+{
+    struct Texture { texture_format format; int width; int height; int pixel_size; };
+    // Tiny textures have every pixel within 4 bytes of the end; packed YUV has pairs of pixels.
+    const Texture textures[] = {
+        {texture_format::rgb8, 64, 48, 3}, {texture_format::rgb8, 1, 1, 3}, {texture_format::rgb8, 1, 7, 3},
+        {texture_format::rgb8, 5, 1, 3}, {texture_format::mono8, 64, 48, 1}, {texture_format::mono8, 1, 1, 1},
+        {texture_format::mono8, 1, 5, 1}, {texture_format::mono8, 3, 1, 1}, {texture_format::yuyv, 64, 48, 2},
+        {texture_format::yuyv, 2, 1, 2}, {texture_format::uyvy, 64, 48, 2}, {texture_format::uyvy, 2, 3, 2},
+    };
+    for (const Texture& texture : textures)
+    {
+        const std::size_t size = static_cast<std::size_t>(texture.width) * texture.height * texture.pixel_size;
+        GuardedBuffer pixels(size);
+        for (std::size_t i = 0; i < size; ++i)
+            pixels.data[i] = static_cast<uint8_t>(random());
+        for (std::size_t count : COUNTS)
+        {
+            // Many points on the last pixels, which the gathers must not read past.
+            std::vector<float> texcoords = randomFloats(random, 2 * count);
+            for (std::size_t i = 0; i < count; i += 3)
+                texcoords[2 * i] = texcoords[2 * i + 1] = 1.f;
+            std::vector<uint32_t> expected(count), actual(count);
+            withScalar([&] { texture_colors(texcoords.data(), count, pixels.data, texture.width, texture.height, texture.format,
+                                            expected.data()); });
+            texture_colors(texcoords.data(), count, pixels.data, texture.width, texture.height, texture.format, actual.data());
+            EXPECT_TRUE(expected == actual) << "format " << static_cast<int>(texture.format) << ", " << texture.width << "x"
+                                            << texture.height << ", " << count << " points";
+        }
+    }
+}
+
+TEST_P(PointCloudKernels, writePointRecords)  // NOLINT
+{
+    for (std::size_t count : COUNTS)
+    {
+        const std::vector<float> vertices = randomFloats(random, 3 * count);
+        std::vector<uint8_t> masks((count + 7) / 8);
+        for (uint8_t& m : masks)
+            m = static_cast<uint8_t>(random());
+        for (std::size_t point_step : {16, 20, 32})
+        {
+            // The bytes after the 16 of a record belong to other fields and stay untouched.
+            std::vector<uint8_t> expected(count * point_step + 8, 0xCD), actual(expected);
+            withScalar([&] { write_point_records(vertices.data(), masks.data(), count, expected.data(), point_step); });
+            write_point_records(vertices.data(), masks.data(), count, actual.data(), point_step);
+            EXPECT_TRUE(expected == actual) << count << " points, point step " << point_step;
+        }
+    }
+}
+
+TEST_P(PointCloudKernels, depthNormals)  // NOLINT
+{
+    // A slanted floor and a box, with holes and depth discontinuities.
+    const int width = 53;
+    const int height = 37;
+    std::vector<uint16_t> depth(width * height);
+    std::vector<float> ray_x(width * height), ray_y(width * height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const int p = y * width + x;
+            ray_x[p] = (x - 26.f) / 40.f;
+            ray_y[p] = (y - 18.f) / 40.f;
+            const bool box = x > 20 && x < 35 && y > 10 && y < 25;
+            depth[p] = (random() % 13 == 0) ? 0 : static_cast<uint16_t>((box ? 900 : 2000 + 15 * y) + random() % 4);
+        }
+    }
+    for (int radius : {1, 2, 3})
+    {
+        // Whole image, and partial chunks starting anywhere in a row.
+        const std::size_t ranges[][2] = {{0, depth.size()}, {5, 17}, {width * 3 + 2, 31}, {width * 10 - 4, 9}, {depth.size() - 7, 7}};
+        for (const auto& range : ranges)
+        {
+            std::vector<float> expected(3 * range[1]), actual(3 * range[1]);
+            withScalar([&] { depth_normals(depth.data(), ray_x.data(), ray_y.data(), width, height, radius, 0.001f, 0.02f,
+                                           range[0], range[1], expected.data()); });
+            depth_normals(depth.data(), ray_x.data(), ray_y.data(), width, height, radius, 0.001f, 0.02f, range[0], range[1],
+                          actual.data());
+            SCOPED_TRACE(testing::Message() << "radius " << radius << ", " << range[1] << " pixels from " << range[0]);
+            expectSameFloats(expected, actual);
+        }
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(SupportedIsas, PointCloudKernels, testing::ValuesIn(supportedIsas()));  // NOLINT
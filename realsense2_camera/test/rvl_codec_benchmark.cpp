@@ -0,0 +1,82 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/rvl_codec.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const int WIDTH = 848;
+    const int HEIGHT = 480;
+    const int FRAMES = 50;
+
+    // Depth in millimeters of a room seen by a D435 at 848x480: a floor, a wall and a box, with
+    // 1 mm of noise and the holes of shadows and of surfaces out of range.
+    std::vector<uint16_t> syntheticDepth()
+    {
+        std::mt19937 random(42);
+        std::normal_distribution<float> noise(0.f, 1.f);
+        std::vector<uint16_t> depth(WIDTH * HEIGHT);
+        for (int y = 0; y < HEIGHT; ++y)
+        {
+            for (int x = 0; x < WIDTH; ++x)
+            {
+                float z = 3000.f + 0.5f * x;
+                if (y > HEIGHT / 2)
+                    z = std::min(z, 1500.f * HEIGHT / 2 / (y - HEIGHT / 2 + 1) + 400.f);
+                if (x > 500 && x < 650 && y > 200 && y < 380)
+                    z = 1200.f + 0.2f * y;
+                const bool hole = (x > 490 && x < 505) || (y < 30 && x < 200) || random() % 50 == 0;
+                depth[y * WIDTH + x] = hole ? 0 : static_cast<uint16_t>(z + noise(random));
+            }
+        }
+        return depth;
+    }
+}
+
+// Encoding and decoding throughput in MB/s of raw depth and compression ratio, from 1 to N bands
+// coded by as many threads. The speedup depends on the cores of the machine, so it is printed
+// rather than checked.
+TEST(RvlCodec, bandScaling)  // NOLINT
+{
+    const std::vector<uint16_t> depth = syntheticDepth();
+    const double raw_megabytes = depth.size() * sizeof(uint16_t) / 1e6;
+    const int max_bands = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+    double single_band_seconds = 0.;
+    for (int band_count = 1; band_count <= max_bands; band_count *= 2)
+    {
+        rvl::Encoder encoder(band_count, band_count);
+        WorkerPool pool(band_count);
+        std::vector<uint8_t> encoded;
+        encoder.encode(depth.data(), WIDTH, HEIGHT, encoded);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FRAMES; ++i)
+            encoder.encode(depth.data(), WIDTH, HEIGHT, encoded);
+        const double encode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / FRAMES;
+        if (band_count == 1)
+            single_band_seconds = encode_seconds;
+
+        std::vector<uint16_t> decoded;
+        int width = 0, height = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < FRAMES; ++i)
+            ASSERT_TRUE(rvl::decode(encoded.data(), encoded.size(), decoded, width, height, &pool));
+        const double decode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / FRAMES;
+        EXPECT_TRUE(decoded == depth);
+
+        printf("%d band(s) and thread(s): encode %.0f MB/s (speedup %.2f), decode %.0f MB/s, compression ratio %.2f\n",
+               band_count, raw_megabytes / encode_seconds, single_band_seconds / encode_seconds,
+               raw_megabytes / decode_seconds, static_cast<double>(depth.size() * sizeof(uint16_t)) / encoded.size());
+    }
+    printf("(%u hardware threads)\n", std::thread::hardware_concurrency());
+}
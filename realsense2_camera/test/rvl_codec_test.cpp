@@ -0,0 +1,90 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/rvl_codec.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    // Encodes and decodes with one thread and with several, which must give the same data.
+    void expectRoundTrip(const std::vector<uint16_t>& depth, int width, int height, int band_count)
+    {
+        std::vector<uint8_t> first_encoded;
+        for (int threads : {1, 3})
+        {
+            rvl::Encoder encoder(band_count, threads);
+            std::vector<uint8_t> encoded;
+            encoder.encode(depth.data(), width, height, encoded);
+            if (first_encoded.empty())
+                first_encoded = encoded;
+            EXPECT_TRUE(encoded == first_encoded) << threads << " threads";
+
+            WorkerPool pool(threads);
+            std::vector<uint16_t> decoded;
+            int decoded_width = 0, decoded_height = 0;
+            ASSERT_TRUE(rvl::decode(encoded.data(), encoded.size(), decoded, decoded_width, decoded_height, &pool));
+            EXPECT_EQ(width, decoded_width);
+            EXPECT_EQ(height, decoded_height);
+            EXPECT_TRUE(decoded == depth) << width << "x" << height << ", " << band_count << " bands, " << threads << " threads";
+        }
+    }
+
+    std::vector<uint16_t> randomDepth(int width, int height, unsigned int seed)
+    {
+        // Random depth with holes, so that both zero and valid runs of any length are coded.
+        std::mt19937 random(seed);
+        std::vector<uint16_t> depth(width * height);
+        for (uint16_t& pixel : depth)
+            pixel = (random() % 4 == 0) ? 0 : static_cast<uint16_t>(random());
+        return depth;
+    }
+}
+
+TEST(RvlCodec, roundTripsRandomDepth)  // NOLINT
+{
+    for (int band_count : {1, 4, 1000})
+        expectRoundTrip(randomDepth(64, 48, 1), 64, 48, band_count);
+}
+
+TEST(RvlCodec, roundTripsZeroDepth)  // NOLINT
+{
+    expectRoundTrip(std::vector<uint16_t>(64 * 48, 0), 64, 48, 4);
+}
+
+TEST(RvlCodec, roundTripsMaxDepth)  // NOLINT
+{
+    expectRoundTrip(std::vector<uint16_t>(64 * 48, 65535), 64, 48, 4);
+
+    // Largest deltas: alternating between 1 and 65535.
+    std::vector<uint16_t> depth(64 * 48);
+    for (std::size_t i = 0; i < depth.size(); ++i)
+        depth[i] = (i % 2) ? 65535 : 1;
+    expectRoundTrip(depth, 64, 48, 4);
+}
+
+TEST(RvlCodec, roundTripsOddSizes)  // NOLINT
+{
+    expectRoundTrip(randomDepth(1, 1, 2), 1, 1, 4);
+    expectRoundTrip(randomDepth(37, 5, 3), 37, 5, 4);
+    expectRoundTrip(randomDepth(847, 479, 4), 847, 479, 7);
+}
+
+TEST(RvlCodec, rejectsTruncatedData)  // NOLINT
+{
+    const std::vector<uint16_t> depth = randomDepth(64, 48, 5);
+    rvl::Encoder encoder(4, 2);
+    std::vector<uint8_t> encoded;
+    encoder.encode(depth.data(), 64, 48, encoded);
+
+    std::vector<uint16_t> decoded;
+    int width = 0, height = 0;
+    EXPECT_FALSE(rvl::decode(encoded.data(), encoded.size() / 2, decoded, width, height));
+    WorkerPool pool(3);
+    EXPECT_FALSE(rvl::decode(encoded.data(), encoded.size() / 2, decoded, width, height, &pool));
+    EXPECT_FALSE(rvl::decode(encoded.data(), 3, decoded, width, height));
+}
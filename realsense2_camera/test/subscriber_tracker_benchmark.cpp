@@ -0,0 +1,133 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/subscriber_tracker.h"
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/Imu.h>
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    const std::chrono::seconds DURATION(5);
+
+    // Queries made by the frame callbacks: one per IMU sample (its sample or imu topic), and one
+    // per output of a depth frame with the outputs of a full configuration: the image and its
+    // camera info, RVL, image_meters, scan, pointcloud, points_with_normals, height_map and the
+    // timestamping info.
+    const double IMU_RATE = 400;
+    const int IMU_QUERIES = 1;
+    const double DEPTH_RATE = 90;
+    const int DEPTH_QUERIES = 9;
+
+    template <typename Message>
+    void messageCallback(const boost::shared_ptr<const Message>&) {}
+
+    double threadCpuSeconds()
+    {
+        timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return time.tv_sec + time.tv_nsec * 1e-9;
+    }
+
+    // CPU time of reading the clock twice, which is taken off the measured query times.
+    double clockSeconds()
+    {
+        const int reads = 100000;
+        const double start = threadCpuSeconds();
+        for (int i = 0; i < reads; ++i)
+            threadCpuSeconds();
+        return (threadCpuSeconds() - start) / reads;
+    }
+
+    // Publishes message at rate for DURATION, making queries queries before every message like
+    // the frame callbacks do, and returns the CPU time of the queries per second.
+    template <typename Message, typename Query>
+    double queryCpuTimePerSecond(ros::Publisher& publisher, const boost::shared_ptr<Message>& message, double rate,
+                                 int queries, Query query)
+    {
+        const double clock_seconds = clockSeconds();
+        const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / rate));
+        auto next = std::chrono::steady_clock::now();
+        const auto end = next + DURATION;
+        double cpu_seconds = 0;
+        int unsubscribed = 0;
+        for (; next < end; next += period)
+        {
+            const double start = threadCpuSeconds();
+            for (int i = 0; i < queries; ++i)
+                unsubscribed += !query();
+            cpu_seconds += threadCpuSeconds() - start - clock_seconds;
+            publisher.publish(message);
+            std::this_thread::sleep_until(next + period);
+        }
+        EXPECT_EQ(0, unsubscribed);
+        return std::max(cpu_seconds, 0.0) / std::chrono::duration<double>(DURATION).count();
+    }
+
+    template <typename Message>
+    ros::Publisher advertise(ros::NodeHandle& node_handle, const std::string& topic, SubscriberTracker& tracker, uint64_t tracker_topic)
+    {
+        return node_handle.advertise<Message>(topic, 1, tracker.connectCallback(tracker_topic), tracker.disconnectCallback(tracker_topic));
+    }
+}
+
+// CPU time spent asking whether topics have subscribers at the rates of the camera: IMU samples at
+// 400 Hz and depth frames at 90 fps, published concurrently on topics with a subscriber. Compares
+// SubscriberTracker with ros::Publisher::getNumSubscribers(), which locks the publication that
+// publishing also locks.
+TEST(SubscriberTracker, cpuTimeAtCameraRates)  // NOLINT
+{
+    ros::NodeHandle node_handle;
+    SubscriberTracker tracker;
+    const uint64_t imu_topic = tracker.addTopic();
+    const uint64_t depth_topic = tracker.addTopic();
+    ros::Publisher imu_publisher = advertise<sensor_msgs::Imu>(node_handle, "benchmark_imu", tracker, imu_topic);
+    ros::Publisher depth_publisher = advertise<sensor_msgs::Image>(node_handle, "benchmark_depth", tracker, depth_topic);
+    ros::Subscriber imu_subscriber = node_handle.subscribe("benchmark_imu", 1, messageCallback<sensor_msgs::Imu>);
+    ros::Subscriber depth_subscriber = node_handle.subscribe("benchmark_depth", 1, messageCallback<sensor_msgs::Image>);
+    for (int i = 0; i < 100 && !(imu_publisher.getNumSubscribers() && depth_publisher.getNumSubscribers() &&
+                                 tracker.hasSubscribers(imu_topic) && tracker.hasSubscribers(depth_topic)); ++i)
+    {
+        ros::spinOnce();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    ASSERT_EQ(1u, imu_publisher.getNumSubscribers());
+    ASSERT_EQ(1u, depth_publisher.getNumSubscribers());
+    ASSERT_TRUE(tracker.hasSubscribers(imu_topic) && tracker.hasSubscribers(depth_topic));
+
+    const sensor_msgs::ImuPtr imu(new sensor_msgs::Imu());
+    const sensor_msgs::ImagePtr depth(new sensor_msgs::Image());
+    for (bool use_tracker : {true, false})
+    {
+        double imu_seconds = 0;
+        std::thread imu_thread([&]
+        {
+            imu_seconds = use_tracker ?
+                queryCpuTimePerSecond(imu_publisher, imu, IMU_RATE, IMU_QUERIES, [&] { return tracker.hasSubscribers(imu_topic); }) :
+                queryCpuTimePerSecond(imu_publisher, imu, IMU_RATE, IMU_QUERIES, [&] { return imu_publisher.getNumSubscribers() > 0; });
+        });
+        const double depth_seconds = use_tracker ?
+            queryCpuTimePerSecond(depth_publisher, depth, DEPTH_RATE, DEPTH_QUERIES, [&] { return tracker.hasSubscribers(depth_topic); }) :
+            queryCpuTimePerSecond(depth_publisher, depth, DEPTH_RATE, DEPTH_QUERIES, [&] { return depth_publisher.getNumSubscribers() > 0; });
+        imu_thread.join();
+        printf("%s: IMU %.0f Hz x %d queries %.2f us/s, depth %.0f fps x %d queries %.2f us/s of CPU time\n",
+               use_tracker ? "SubscriberTracker" : "getNumSubscribers()", IMU_RATE, IMU_QUERIES, imu_seconds * 1e6,
+               DEPTH_RATE, DEPTH_QUERIES, depth_seconds * 1e6);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    ros::init(argc, argv, "subscriber_tracker_benchmark");
+    return RUN_ALL_TESTS();
+}
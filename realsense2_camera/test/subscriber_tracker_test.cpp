@@ -0,0 +1,95 @@
+// License: Apache 2.0. See LICENSE file in root directory.
+
+#include "../include/subscriber_tracker.h"
+
+#include <gtest/gtest.h>
+
+using namespace realsense2_camera;
+
+namespace
+{
+    // The callbacks only count connections, they never look at the subscriber.
+    void connect(SubscriberTracker& tracker, uint64_t topic)
+    {
+        tracker.connectCallback(topic)(ros::SingleSubscriberPublisher(ros::SubscriberLinkPtr()));
+    }
+
+    void disconnect(SubscriberTracker& tracker, uint64_t topic)
+    {
+        tracker.disconnectCallback(topic)(ros::SingleSubscriberPublisher(ros::SubscriberLinkPtr()));
+    }
+
+    image_transport::SingleSubscriberPublisher imageSubscriber()
+    {
+        return image_transport::SingleSubscriberPublisher("", "", image_transport::SingleSubscriberPublisher::GetNumSubscribersFn(),
+                                                          image_transport::SingleSubscriberPublisher::PublishFn());
+    }
+}
+
+TEST(SubscriberTracker, countsConnections)  // NOLINT
+{
+    SubscriberTracker tracker;
+    const uint64_t topic = tracker.addTopic();
+    EXPECT_FALSE(tracker.hasSubscribers(topic));
+
+    connect(tracker, topic);
+    connect(tracker, topic);
+    EXPECT_TRUE(tracker.hasSubscribers(topic));
+    disconnect(tracker, topic);
+    EXPECT_TRUE(tracker.hasSubscribers(topic));
+    disconnect(tracker, topic);
+    EXPECT_FALSE(tracker.hasSubscribers(topic));
+
+    connect(tracker, topic);
+    EXPECT_TRUE(tracker.hasSubscribers(topic));
+}
+
+TEST(SubscriberTracker, tracksTopicsSeparately)  // NOLINT
+{
+    SubscriberTracker tracker;
+    const uint64_t first = tracker.addTopic();
+    const uint64_t second = tracker.addTopic();
+    EXPECT_EQ(0u, first & second);
+
+    connect(tracker, second);
+    EXPECT_EQ(second, tracker.subscribed());
+    EXPECT_FALSE(tracker.hasSubscribers(first));
+    EXPECT_TRUE(tracker.hasSubscribers(second));
+    EXPECT_TRUE(tracker.hasSubscribers(first | second));
+    EXPECT_FALSE(tracker.hasSubscribers(0));
+
+    connect(tracker, first);
+    disconnect(tracker, second);
+    EXPECT_EQ(first, tracker.subscribed());
+}
+
+TEST(SubscriberTracker, sharesBitsBetweenPublishers)  // NOLINT
+{
+    // An image and its camera info: the topic has subscribers while either publisher has.
+    SubscriberTracker tracker;
+    const uint64_t topic = tracker.addTopic();
+    tracker.imageConnectCallback(topic)(imageSubscriber());
+    connect(tracker, topic);
+    tracker.imageDisconnectCallback(topic)(imageSubscriber());
+    EXPECT_TRUE(tracker.hasSubscribers(topic));
+    disconnect(tracker, topic);
+    EXPECT_FALSE(tracker.hasSubscribers(topic));
+}
+
+TEST(SubscriberTracker, tracksAtMost64Topics)  // NOLINT
+{
+    SubscriberTracker tracker;
+    uint64_t topics = 0;
+    for (int i = 0; i < 64; ++i)
+    {
+        const uint64_t topic = tracker.addTopic();
+        EXPECT_EQ(0u, topics & topic);
+        topics |= topic;
+    }
+    EXPECT_EQ(~uint64_t(0), topics);
+    EXPECT_THROW(tracker.addTopic(), std::runtime_error);
+
+    const uint64_t last = uint64_t(1) << 63;
+    connect(tracker, last);
+    EXPECT_EQ(last, tracker.subscribed());
+}